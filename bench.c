@@ -0,0 +1,750 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#define RNG_IMPLEMENTATION
+#include "rng.h"
+
+#define KERNELS_IMPLEMENTATION
+#include "kernels.h"
+
+#define POOL_IMPLEMENTATION
+#include "pool.h"
+
+#define DIST_IMPLEMENTATION
+#include "dist.h"
+
+#define EXPR_IMPLEMENTATION
+#include "expr.h"
+
+#define MC_IMPLEMENTATION
+#include "montecarlo.h"
+
+#define MACRO_IMPLEMENTATION
+#include "macro.h"
+
+#define RPRAND_IMPLEMENTATION
+#include "external/rprand.h"
+
+// Benchmarks for the dice code paths that have to scale to huge pools.
+// Build and run with `./nob bench [section...]`, no arguments runs every section.
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static const size_t bench_sizes[] = { 1000, 1000000, 100000000 };
+#define BENCH_SIZE_COUNT (sizeof(bench_sizes)/sizeof(bench_sizes[0]))
+
+// Keeps the compiler from throwing away the work being measured
+static volatile uint64_t bench_sink = 0;
+
+static void report(const char *what, size_t n, double seconds, const char *unit) {
+    printf("  %-28s n=%-10zu %10.3f ms  %10.1f M%s/s\n", what, n, seconds * 1000.0, (double)n / seconds / 1e6, unit);
+}
+
+static void bench_rng(void) {
+    size_t max_n = bench_sizes[BENCH_SIZE_COUNT - 1];
+    uint8_t *dice = malloc(max_n);
+
+    for(size_t s = 0; s < BENCH_SIZE_COUNT; s++) {
+        size_t n = bench_sizes[s];
+
+        rprand_set_seed(100);
+        double start = now_seconds();
+        for(size_t i = 0; i < n; i++) dice[i] = (uint8_t)rprand_get_value(1, 6);
+        report("rprand_get_value per die", n, now_seconds() - start, "dice");
+        bench_sink += dice[n - 1];
+
+        Rng rng;
+        rng_seed(&rng, 100);
+        start = now_seconds();
+        rng_fill_dice(&rng, dice, n, 6);
+        report("rng_fill_dice batch", n, now_seconds() - start, "dice");
+        bench_sink += dice[n - 1];
+    }
+
+    free(dice);
+}
+
+static void bench_rng_parallel(void) {
+    size_t n = bench_sizes[BENCH_SIZE_COUNT - 1];
+    uint8_t *dice = malloc(n);
+
+    long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t thread_counts[] = { 1, 2, 4, cpu_count > 0 ? (size_t)cpu_count : 1 };
+
+    for(size_t t = 0; t < sizeof(thread_counts)/sizeof(thread_counts[0]); t++) {
+        Rng rng;
+        rng_seed(&rng, 100);
+
+        double start = now_seconds();
+        rng_fill_dice_parallel(&rng, dice, n, 6, thread_counts[t]);
+        double elapsed = now_seconds() - start;
+
+        uint64_t checksum = 0;
+        for(size_t i = 0; i < n; i++) checksum = checksum * 31 + dice[i];
+
+        char label[64];
+        snprintf(label, sizeof(label), "%zu threads (sum %016llx)", thread_counts[t], (unsigned long long)checksum);
+        report(label, n, elapsed, "dice");
+    }
+
+    free(dice);
+}
+
+static size_t peak_rss_bytes(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (size_t)usage.ru_maxrss * 1024;
+}
+
+static void bench_pool(void) {
+    for(size_t s = 0; s < BENCH_SIZE_COUNT; s++) {
+        size_t n = bench_sizes[s];
+
+        // What the pool would look like as one growable array: every doubling
+        // holds the old and the new buffer at once and copies everything over
+        uint8_t *array = NULL;
+        size_t array_capacity = 0, array_peak = 0;
+        double start = now_seconds();
+        for(size_t i = 0; i < n; i++) {
+            if(i == array_capacity) {
+                size_t capacity = array_capacity == 0 ? 256 : array_capacity * 2;
+                if(array_capacity + capacity > array_peak) array_peak = array_capacity + capacity;
+                array = realloc(array, capacity);
+                array_capacity = capacity;
+            }
+            array[i] = (uint8_t)(i % 6 + 1);
+        }
+        report("growable array add", n, now_seconds() - start, "dice");
+        bench_sink += array[n - 1];
+        free(array);
+
+        DicePool pool = {0};
+        size_t pool_peak = 0;
+        start = now_seconds();
+        for(size_t i = 0; i < n; i++) {
+            pool_push(&pool, (Die){ .value = (uint8_t)(i % 6 + 1) });
+            if(i % POOL_PAGE_SIZE == 0 && pool_memory_usage(&pool) > pool_peak) pool_peak = pool_memory_usage(&pool);
+        }
+        report("paged pool add", n, now_seconds() - start, "dice");
+
+        Rng rng;
+        rng_seed(&rng, 100);
+        start = now_seconds();
+        pool_roll(&pool, &rng, 6, 1);
+        report("paged pool roll", n, now_seconds() - start, "dice");
+
+        start = now_seconds();
+        bench_sink += pool_sum(&pool);
+        report("paged pool sum", n, now_seconds() - start, "dice");
+
+        start = now_seconds();
+        pool_sort_descending(&pool);
+        report("paged pool sort", n, now_seconds() - start, "dice");
+
+        start = now_seconds();
+        while(pool_pop(&pool, NULL)) {}
+        report("paged pool remove", n, now_seconds() - start, "dice");
+        pool_free(&pool);
+
+        // Keeping the pool sorted while adding, the old way sorted everything again
+        // after every die, which only finishes in reasonable time for the small pool
+        if(n <= bench_sizes[0]) {
+            start = now_seconds();
+            for(size_t i = 0; i < n; i++) {
+                pool_push(&pool, (Die){ .value = (uint8_t)(i % 6 + 1) });
+                pool_sort_descending(&pool);
+            }
+            report("paged pool add + full sort", n, now_seconds() - start, "dice");
+            pool_free(&pool);
+        }
+
+        start = now_seconds();
+        for(size_t i = 0; i < n; i++) pool_insert_sorted(&pool, (Die){ .value = (uint8_t)(i % 6 + 1) });
+        report("paged pool sorted insert", n, now_seconds() - start, "dice");
+        pool_free(&pool);
+
+        printf("  peak memory: growable array %.2f MiB, paged pool %.2f MiB\n",
+               (double)array_peak / (1 << 20), (double)pool_peak / (1 << 20));
+    }
+
+    printf("  process peak RSS: %.2f MiB\n", (double)peak_rss_bytes() / (1 << 20));
+}
+
+static void bench_packed(void) {
+    static const char *storage_names[] = { "byte", "nibble", "base-6" };
+    size_t n = bench_sizes[BENCH_SIZE_COUNT - 1];
+
+    for(PoolStorage storage = POOL_STORAGE_BYTE; storage <= POOL_STORAGE_BASE6; storage++) {
+        DicePool pool = { .storage = storage };
+        pool_resize(&pool, n);
+
+        Rng rng;
+        rng_seed(&rng, 100);
+        pool_roll(&pool, &rng, 6, 1);
+
+        printf("  %s storage: %.2f MiB\n", storage_names[storage], (double)pool_memory_usage(&pool) / (1 << 20));
+
+        double start = now_seconds();
+        bench_sink += pool_sum(&pool);
+        report("sum", n, now_seconds() - start, "dice");
+
+        uint64_t counts[POOL_MAX_FACES];
+        start = now_seconds();
+        pool_face_counts(&pool, counts);
+        report("face counts", n, now_seconds() - start, "dice");
+        bench_sink += counts[6];
+
+        start = now_seconds();
+        bench_sink += pool_count_at_least(&pool, 4);
+        report("count >= 4", n, now_seconds() - start, "dice");
+
+        if(storage == POOL_STORAGE_BYTE) {
+            uint64_t successes = 0;
+            start = now_seconds();
+            for(size_t p = 0; p < pool.page_count && p * POOL_PAGE_SIZE < n; p++) {
+                const volatile uint8_t *page = pool.pages[p];
+                size_t count = n - p * POOL_PAGE_SIZE < POOL_PAGE_SIZE ? n - p * POOL_PAGE_SIZE : POOL_PAGE_SIZE;
+                for(size_t i = 0; i < count; i++) successes += page[i] >= 4;
+            }
+            report("count >= 4 scalar loop", n, now_seconds() - start, "dice");
+            bench_sink += successes;
+        }
+
+        pool_free(&pool);
+    }
+}
+
+static void bench_histogram(void) {
+    static const size_t histogram_sizes[] = { 1000, 1000000, 100000000, 10000000000ULL };
+
+    for(size_t s = 0; s < sizeof(histogram_sizes)/sizeof(histogram_sizes[0]); s++) {
+        size_t n = histogram_sizes[s];
+        Rng rng;
+        rng_seed(&rng, 100);
+
+        // Materializing 10^10 dice one per byte does not fit in memory
+        if(n <= bench_sizes[BENCH_SIZE_COUNT - 1]) {
+            DicePool pool = {0};
+            pool_resize(&pool, n);
+            double start = now_seconds();
+            pool_roll(&pool, &rng, 6, 1);
+            report("pool_roll", n, now_seconds() - start, "dice");
+            pool_free(&pool);
+        }
+
+        DicePool pool = {0};
+        double start = now_seconds();
+        pool_roll_histogram(&pool, &rng, n, 6);
+        report("pool_roll_histogram", n, now_seconds() - start, "dice");
+        bench_sink += pool.sum;
+
+        size_t screen = n < 1000 ? n : 1000;
+        start = now_seconds();
+        pool_materialize(&pool, screen);
+        report("materialize a screen", screen, now_seconds() - start, "dice");
+
+        if(n <= bench_sizes[BENCH_SIZE_COUNT - 1]) {
+            start = now_seconds();
+            pool_materialize(&pool, n);
+            report("materialize everything", n, now_seconds() - start, "dice");
+        }
+
+        pool_free(&pool);
+    }
+}
+
+// Convolving one die at a time, what computing NdS costs without the FFT
+static double *naive_dice_sum(uint64_t amount, uint32_t sides) {
+    size_t  count = 1;
+    double *pmf   = calloc(amount * (sides - 1) + 1, sizeof(double));
+    double *next  = calloc(amount * (sides - 1) + 1, sizeof(double));
+    pmf[0] = 1.0;
+
+    for(uint64_t n = 0; n < amount; n++) {
+        memset(next, 0, (count + sides - 1) * sizeof(double));
+        for(size_t i = 0; i < count; i++)
+            for(uint32_t face = 0; face < sides; face++) next[i + face] += pmf[i] / sides;
+
+        count += sides - 1;
+        double *swap = pmf;
+        pmf  = next;
+        next = swap;
+    }
+
+    free(next);
+    return pmf;
+}
+
+static void bench_dist(void) {
+    static const struct { uint64_t amount; uint32_t sides; } rolls[] = {
+        { 100, 6 }, { 1000, 20 }, { 10000, 20 }, { 100000, 6 },
+    };
+
+    for(size_t r = 0; r < sizeof(rolls)/sizeof(rolls[0]); r++) {
+        uint64_t amount = rolls[r].amount;
+        uint32_t sides  = rolls[r].sides;
+
+        DiceDist dist = {0};
+        double start = now_seconds();
+        dist_dice_sum(&dist, amount, sides);
+        double fast = now_seconds() - start;
+
+        printf("  %llud%u: dist_dice_sum %.3f ms", (unsigned long long)amount, sides, fast * 1000.0);
+
+        if(amount * sides <= 20000) {
+            start = now_seconds();
+            double *naive = naive_dice_sum(amount, sides);
+            double slow = now_seconds() - start;
+
+            double max_error = 0.0;
+            for(size_t i = 0; i < dist.count; i++)
+                if(fabs(naive[i] - dist.pmf[i]) > max_error) max_error = fabs(naive[i] - dist.pmf[i]);
+
+            printf(", naive %.3f ms, max difference %.2g", slow * 1000.0, max_error);
+            free(naive);
+        }
+
+        printf("\n");
+        dist_free(&dist);
+    }
+}
+
+static void bench_successes(void) {
+    static const uint64_t amounts[] = { 1000, 100000, 1000000 };
+
+    for(size_t a = 0; a < sizeof(amounts)/sizeof(amounts[0]); a++) {
+        // The second run finds the log factorials already there
+        for(int run = 0; run < 2; run++) {
+            DiceDist dist = {0};
+            double start = now_seconds();
+            dist_successes(&dist, amounts[a], 1.0 / 3.0);
+            double elapsed = now_seconds() - start;
+
+            printf("  %llu dice >= 5 on a d6, %s: %.3f ms, P(at least a third) %.6f\n", (unsigned long long)amounts[a],
+                   run == 0 ? "cold" : "warm", elapsed * 1000.0, dist_at_least(&dist, (int64_t)(amounts[a] / 3)));
+            dist_free(&dist);
+        }
+    }
+}
+
+static void bench_expr(void) {
+    static const struct { const char *text; size_t evals; } rolls[] = {
+        { "12d6 + 4d8 + 5", 1000000 }, { "4d6kh3", 1000000 }, { "8d10 >= 7", 1000000 }, { "1000000d6", 10000 },
+    };
+
+    for(size_t r = 0; r < sizeof(rolls)/sizeof(rolls[0]); r++) {
+        size_t evals = rolls[r].evals;
+        Rng rng;
+        rng_seed(&rng, 100);
+
+        // What replaying a macro used to cost, parsing the text every time
+        double start = now_seconds();
+        for(size_t i = 0; i < evals; i++) {
+            Expr expr;
+            expr_compile(&expr, rolls[r].text, NULL);
+            bench_sink += (uint64_t)expr_eval(&expr, &rng);
+            expr_free(&expr);
+        }
+        double parsing = now_seconds() - start;
+
+        Expr expr;
+        expr_compile(&expr, rolls[r].text, NULL);
+        start = now_seconds();
+        for(size_t i = 0; i < evals; i++) bench_sink += (uint64_t)expr_eval(&expr, &rng);
+        double compiled = now_seconds() - start;
+        expr_free(&expr);
+
+        printf("  %-16s %zu rolls: compile every time %.3f ms, compiled once %.3f ms (%.0f ns per roll)\n",
+               rolls[r].text, evals, parsing * 1000.0, compiled * 1000.0, compiled / (double)evals * 1e9);
+    }
+}
+
+// Every one of the sides^amount rolls, sorted and summed, what keeping costs without the DP
+static double *naive_keep_highest(uint32_t amount, uint32_t sides, uint32_t keep) {
+    double  *pmf   = calloc(keep * sides + 1, sizeof(double));
+    uint32_t faces[16] = {0};
+
+    double chance = pow(1.0 / sides, amount);
+    for(;;) {
+        uint32_t sorted[16];
+        memcpy(sorted, faces, amount * sizeof(uint32_t));
+        for(uint32_t i = 1; i < amount; i++)
+            for(uint32_t j = i; j > 0 && sorted[j - 1] < sorted[j]; j--) {
+                uint32_t swap = sorted[j];
+                sorted[j]     = sorted[j - 1];
+                sorted[j - 1] = swap;
+            }
+
+        uint32_t sum = 0;
+        for(uint32_t i = 0; i < keep; i++) sum += sorted[i] + 1;
+        pmf[sum] += chance;
+
+        uint32_t digit = 0;
+        while(digit < amount && ++faces[digit] == sides) faces[digit++] = 0;
+        if(digit == amount) break;
+    }
+
+    return pmf;
+}
+
+static int compare_descending(const void *a, const void *b) {
+    return (int)*(const uint8_t *)b - (int)*(const uint8_t *)a;
+}
+
+static void bench_keep(void) {
+    static const struct { uint32_t amount, sides, keep; } rolls[] = {
+        { 4, 6, 3 }, { 8, 6, 3 }, { 100, 6, 50 }, { 1000, 6, 3 }, { 1000, 6, 999 },
+    };
+
+    uint32_t values[7] = { 0, 1, 2, 3, 4, 5, 6 };
+    for(size_t r = 0; r < sizeof(rolls)/sizeof(rolls[0]); r++) {
+        DiceDist dist = {0};
+        double start = now_seconds();
+        dist_keep(&dist, rolls[r].amount, rolls[r].sides, rolls[r].keep, true, values, NULL, 1 << 21);
+        double fast = now_seconds() - start;
+
+        printf("  %ud%ukh%u: dist_keep %.3f ms, mean %.4f", rolls[r].amount, rolls[r].sides, rolls[r].keep, fast * 1000.0, dist_mean(&dist));
+
+        if(rolls[r].amount <= 8) {
+            start = now_seconds();
+            double *naive = naive_keep_highest(rolls[r].amount, rolls[r].sides, rolls[r].keep);
+            double slow = now_seconds() - start;
+
+            double max_error = 0.0;
+            for(size_t i = 0; i < dist.count; i++)
+                if(fabs(naive[dist.min + i] - dist.pmf[i]) > max_error) max_error = fabs(naive[dist.min + i] - dist.pmf[i]);
+
+            printf(", every roll %.3f ms, max difference %.2g", slow * 1000.0, max_error);
+            free(naive);
+        }
+
+        printf("\n");
+        dist_free(&dist);
+    }
+
+    // Sampling walks the face histogram from the top instead of sorting the dice
+    Rng rng;
+    rng_seed(&rng, 100);
+
+    Expr expr;
+    expr_compile(&expr, "100d6kh3", NULL);
+    size_t evals = 100000;
+
+    double start = now_seconds();
+    for(size_t i = 0; i < evals; i++) bench_sink += (uint64_t)expr_eval(&expr, &rng);
+    double histogram = now_seconds() - start;
+    expr_free(&expr);
+
+    uint8_t dice[100];
+    start = now_seconds();
+    for(size_t i = 0; i < evals; i++) {
+        rng_fill_dice(&rng, dice, 100, 6);
+        qsort(dice, 100, 1, compare_descending);
+        bench_sink += dice[0] + dice[1] + dice[2];
+    }
+    double sorting = now_seconds() - start;
+
+    printf("  100d6kh3 %zu rolls: histogram %.3f ms, sorting every roll %.3f ms\n", evals, histogram * 1000.0, sorting * 1000.0);
+}
+
+static void bench_explode(void) {
+    static const struct { const char *text; size_t samples; } rolls[] = {
+        { "3d6!", 100000000 }, { "10d10r1", 10000000 }, { "4d6r<3kh3", 10000000 }, { "2d6! + 1d8r<3", 10000000 },
+    };
+
+    for(size_t r = 0; r < sizeof(rolls)/sizeof(rolls[0]); r++) {
+        Rng rng;
+        rng_seed(&rng, 100);
+
+        Expr expr;
+        expr_compile(&expr, rolls[r].text, NULL);
+
+        ExprDistCache cache = { .tolerance = 1e-9 };
+        DiceDist dist = {0};
+        double start = now_seconds();
+        expr_distribution(&expr, &cache, &dist, NULL);
+        double exact = now_seconds() - start;
+
+        size_t  samples = rolls[r].samples;
+        size_t *hits    = calloc(dist.count, sizeof(size_t));
+        size_t  outside = 0;
+
+        start = now_seconds();
+        for(size_t i = 0; i < samples; i++) {
+            int64_t value = expr_eval(&expr, &rng) - dist.min;
+            if(value < 0 || value >= (int64_t)dist.count) outside++;
+            else                                          hits[value]++;
+        }
+        double sampling = now_seconds() - start;
+
+        // Largest gap between the sampled and exact CDF, which for this many samples
+        // stays below 1.95 / sqrt(samples) 99.9% of the time
+        double gap = 0.0, sampled = 0.0;
+        for(size_t i = 0; i < dist.count; i++) {
+            sampled += (double)hits[i] / (double)samples;
+            if(fabs(sampled - dist.cdf[i]) > gap) gap = fabs(sampled - dist.cdf[i]);
+        }
+
+        printf("  %-14s exact %.3f ms, left out %.2g (tolerance %.0g); %zu samples %.0f ms, %zu outside, CDF gap %.2g (noise %.2g)\n",
+               rolls[r].text, exact * 1000.0, 1.0 - dist.cdf[dist.count - 1], cache.tolerance, samples, sampling * 1000.0,
+               outside, gap, 1.95 / sqrt((double)samples));
+
+        free(hits);
+        dist_free(&dist);
+        expr_dist_cache_free(&cache);
+        expr_free(&expr);
+    }
+}
+
+static void bench_expr_dist(void) {
+    // A panel of similar macros, every one of them reusing the same few terms
+    static const char *macros[] = {
+        "200d6 + 100d8 + 5", "200d6 + 100d8 - 3", "200d6 * 2 + 100d8", "100d8 - 200d6", "200d6 + 100d8 >= 1200",
+        "200d6 + 50d12",     "50d12 + 100d8",     "200d6 + 200d6",     "100d8 * 3 + 7",  "50d12 + 200d6 + 100d8",
+    };
+    size_t count = sizeof(macros)/sizeof(macros[0]);
+
+    Expr exprs[sizeof(macros)/sizeof(macros[0])];
+    for(size_t i = 0; i < count; i++) expr_compile(&exprs[i], macros[i], NULL);
+
+    double timings[2];
+    for(int shared = 0; shared < 2; shared++) {
+        ExprDistCache cache = {0};
+        double start = now_seconds();
+        for(size_t i = 0; i < count; i++) {
+            ExprDistCache own = {0};
+            DiceDist dist = {0};
+            expr_distribution(&exprs[i], shared ? &cache : &own, &dist, NULL);
+            bench_sink += (uint64_t)dist.count;
+            dist_free(&dist);
+            expr_dist_cache_free(&own);
+        }
+        timings[shared] = now_seconds() - start;
+
+        if(shared) printf("  %zu macros, %zu distinct terms computed, %zu reused\n", count, cache.misses, cache.hits);
+        expr_dist_cache_free(&cache);
+    }
+
+    printf("  cache per macro %.3f ms, one shared cache %.3f ms\n", timings[0] * 1000.0, timings[1] * 1000.0);
+
+    for(size_t i = 0; i < count; i++) expr_free(&exprs[i]);
+}
+
+static void bench_macros(void) {
+    static const size_t counts[] = { 1000, 10000, 20000 };
+
+    for(size_t c = 0; c < sizeof(counts)/sizeof(counts[0]); c++) {
+        size_t count = counts[c];
+        char (*names)[32] = malloc(count * sizeof(*names));
+        for(size_t i = 0; i < count; i++) snprintf(names[i], sizeof(names[i]), "attack %zu", i * 7919 % count);
+
+        // What the panel used to do, strcmp over every name before adding and
+        // memmove on delete
+        char **list = malloc(count * sizeof(*list));
+        size_t listed = 0;
+
+        double start = now_seconds();
+        for(size_t i = 0; i < count; i++) {
+            bool exists = false;
+            for(size_t j = 0; j < listed && !exists; j++) exists = strcmp(list[j], names[i]) == 0;
+            if(!exists) list[listed++] = strdup(names[i]);
+        }
+        for(size_t i = 0; i < count; i++) {
+            size_t at = 0;
+            while(strcmp(list[at], names[i]) != 0) at++;
+            free(list[at]);
+            memmove(&list[at], &list[at + 1], (listed - at - 1) * sizeof(*list));
+            listed--;
+        }
+        double linear = now_seconds() - start;
+        free(list);
+
+        MacroTable   table   = {0};
+        MacroHandle *handles = malloc(count * sizeof(*handles));
+
+        start = now_seconds();
+        for(size_t i = 0; i < count; i++) {
+            Expr expr = {0};
+            macro_table_add(&table, names[i], "1d20 + 5", &expr, &handles[i]);
+        }
+        for(size_t i = 0; i < count; i++) {
+            MacroHandle handle;
+            if(macro_table_find(&table, names[i], &handle)) macro_table_remove(&table, handle);
+        }
+        double hashed = now_seconds() - start;
+
+        printf("  %zu macros added and deleted by name: linear list %.3f ms, hash table %.3f ms\n", count, linear * 1000.0, hashed * 1000.0);
+
+        macro_table_free(&table);
+        free(handles);
+        free(names);
+    }
+}
+
+static void bench_library(void) {
+    static const char *rolls[] = { "1d20 + 5", "4d6kh3", "2d6! + 1d8r<3", "8d6 - 1d4 + 3", "(1d20 + 7) >= 15" };
+    const size_t count = 100000;
+
+    MacroTable table = {0};
+    char       name[64];
+    for(size_t i = 0; i < count; i++) {
+        Expr expr;
+        snprintf(name, sizeof(name), "attack %zu", i);
+        expr_compile(&expr, rolls[i % 5], NULL);
+        macro_table_add(&table, name, rolls[i % 5], &expr, NULL);
+    }
+
+    const char *binary = "./build/bench_macros.dmac";
+    const char *text   = "./build/bench_macros.txt";
+
+    double start = now_seconds();
+    bool   saved = macro_table_save(&table, binary);
+    double save  = now_seconds() - start;
+
+    start = now_seconds();
+    bool exported = macro_table_export(&table, text);
+    double export = now_seconds() - start;
+
+    if(!saved || !exported) {
+        printf("  could not write the files under ./build\n");
+        macro_table_free(&table);
+        return;
+    }
+
+    // Opening only checks that everything points inside the file
+    MacroLibrary library;
+    start = now_seconds();
+    bool   opened = macro_library_open(&library, binary);
+    double open   = now_seconds() - start;
+    if(opened) macro_library_close(&library);
+
+    MacroTable      loaded = {0}, imported = {0};
+    MacroFileReport report;
+
+    start = now_seconds();
+    macro_table_load(&loaded, binary, &report);
+    double load = now_seconds() - start;
+
+    start = now_seconds();
+    macro_table_import(&imported, text, &report);
+    double import = now_seconds() - start;
+
+    printf("  %zu macros: save %.3f ms, open mapped %.3f ms, load into a table %.3f ms\n", count, save * 1000.0, open * 1000.0, load * 1000.0);
+    printf("  %zu lines: export %.3f ms, import %.3f ms (%zu added)\n", count, export * 1000.0, import * 1000.0, report.added);
+
+    macro_table_free(&imported);
+    macro_table_free(&loaded);
+    macro_table_free(&table);
+}
+
+static void bench_montecarlo(void) {
+    static const char *rolls[] = { "2d6 + 1d8 + 3", "8d10 >= 7", "4d6kh3", "3d6! + 10d10r1" };
+    const size_t n = 1 << 20;
+
+    // One roll at a time against the whole batch going through each op together
+    int64_t *values = malloc(n * sizeof(*values));
+    for(size_t r = 0; r < sizeof(rolls)/sizeof(rolls[0]); r++) {
+        Expr expr;
+        expr_compile(&expr, rolls[r], NULL);
+
+        Rng rng;
+        rng_seed(&rng, 1);
+
+        double start = now_seconds();
+        for(size_t i = 0; i < n; i++) values[i] = expr_eval(&expr, &rng);
+        double single = now_seconds() - start;
+        bench_sink += (uint64_t)values[n - 1];
+
+        start = now_seconds();
+        expr_eval_batch(&expr, &rng, values, n);
+        double batch = now_seconds() - start;
+        bench_sink += (uint64_t)values[n - 1];
+
+        char label[64];
+        snprintf(label, sizeof(label), "%s one by one", rolls[r]);
+        report(label, n, single, "rolls");
+        snprintf(label, sizeof(label), "%s batched", rolls[r]);
+        report(label, n, batch, "rolls");
+
+        expr_free(&expr);
+    }
+    free(values);
+
+    long   cpu_count       = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t thread_counts[] = { 1, 2, 4, cpu_count > 0 ? (size_t)cpu_count : 1 };
+
+    for(size_t r = 0; r < sizeof(rolls)/sizeof(rolls[0]); r++) {
+        Expr expr;
+        expr_compile(&expr, rolls[r], NULL);
+
+        // A fixed amount of samples shows how it scales, the interval run when it stops
+        for(size_t t = 0; t < sizeof(thread_counts)/sizeof(thread_counts[0]); t++) {
+            McConfig config = { .seed = 1, .threads = thread_counts[t], .max_samples = 1 << 22 };
+            McResult result;
+            if(!mc_run(&expr, &config, &result, NULL)) continue;
+
+            printf("  %-16s %3zu threads  %10llu rolls %9.3f ms  %8.1f Mrolls/s  mean %.4f +- %.4f\n", rolls[r], result.threads,
+                (unsigned long long)result.samples, result.seconds * 1000.0, result.samples_per_second / 1e6, result.mean, result.mean_width / 2.0);
+            dist_free(&result.dist);
+        }
+
+        McConfig config = { .seed = 1, .probability_width = 0.001 };
+        McResult result;
+        if(mc_run(&expr, &config, &result, NULL)) {
+            printf("  %-16s every P(>= x) within +- %.5f: %llu rolls in %zu rounds, %.3f ms\n", rolls[r], result.probability_width / 2.0,
+                (unsigned long long)result.samples, result.rounds, result.seconds * 1000.0);
+            dist_free(&result.dist);
+        }
+
+        expr_free(&expr);
+    }
+}
+
+typedef struct BenchSection {
+    const char *name;
+    void (*run)(void);
+} BenchSection;
+
+static const BenchSection sections[] = {
+    { "rng",          bench_rng          },
+    { "rng_parallel", bench_rng_parallel },
+    { "pool",         bench_pool         },
+    { "packed",       bench_packed       },
+    { "histogram",    bench_histogram    },
+    { "dist",         bench_dist         },
+    { "successes",    bench_successes    },
+    { "expr",         bench_expr         },
+    { "keep",         bench_keep         },
+    { "explode",      bench_explode      },
+    { "expr_dist",    bench_expr_dist    },
+    { "macros",       bench_macros       },
+    { "library",      bench_library      },
+    { "montecarlo",   bench_montecarlo   },
+};
+
+#define SECTION_COUNT (sizeof(sections)/sizeof(sections[0]))
+
+int main(int argc, char **argv) {
+    for(size_t i = 0; i < SECTION_COUNT; i++) {
+        bool selected = argc <= 1;
+        for(int a = 1; a < argc; a++)
+            if(strcmp(argv[a], sections[i].name) == 0) selected = true;
+
+        if(!selected) continue;
+
+        printf("%s:\n", sections[i].name);
+        sections[i].run();
+    }
+
+    return 0;
+}
@@ -0,0 +1,381 @@
+#ifndef CLI_H
+#define CLI_H
+
+// Rolling without a window, for batch jobs:
+//
+//   dice --roll "12d6+5" [--count 1e9] [--format bin|csv|hist] [--seed N] [--threads N] [--stats]
+//
+// bin writes every result as a little endian int64, csv one result per line and hist
+// a `result,count` line for every result that came up, lowest first, once they are
+// all rolled. --stats reports the time and throughput on stderr afterwards.
+//
+// Results are made in rounds of RNG_BLOCK sized blocks through rng_run_blocks, so every
+// block is rolled and formatted (or counted) on one thread into a buffer of its own,
+// and the output for a seed is the same however many threads there are. While the
+// workers fill one round a writer thread hands the round before to stdout, one write
+// per block.
+//
+// #define CLI_IMPLEMENTATION in exactly one file before including this, rng.h,
+// kernels.h, dist.h, expr.h and montecarlo.h have to be included first.
+
+#include <stdbool.h>
+
+bool cli_wanted(int argc, char **argv); // the arguments ask for a headless roll
+int  cli_run(int argc, char **argv);    // exit code
+
+#endif // CLI_H
+
+#ifdef CLI_IMPLEMENTATION
+#undef CLI_IMPLEMENTATION
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+// Longest line a result can take, "-9223372036854775808\n"
+#define CLI_MAX_LINE 21
+
+typedef enum CliFormat {
+    CLI_FORMAT_BIN,
+    CLI_FORMAT_CSV,
+    CLI_FORMAT_HIST,
+} CliFormat;
+
+typedef struct CliBuffer {
+    char  *data;
+    size_t size;
+    size_t capacity;
+    bool   out_of_memory; // it could not grow, what is in it is short
+} CliBuffer;
+
+typedef struct CliRound {
+    const Expr  *expr;
+    CliFormat    format;
+    CliBuffer   *buffers;    // one per block of the round
+    McHistogram *histograms; // one per block of a round, kept from round to round
+    bool        *too_wide;   // per block, its histogram refused a result
+} CliRound;
+
+typedef struct CliWriter {
+    CliBuffer *buffers;
+    size_t     count;
+    bool       failed;
+    pthread_t  thread;
+} CliWriter;
+
+static const char cli_digit_pairs[] =
+    "0001020304050607080910111213141516171819202122232425262728293031323334353637383940414243444546474849"
+    "5051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+
+// Writes value and a newline at out, two digits per division
+static char *cli_format_line(char *out, int64_t value) {
+    uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+
+    char  digits[20];
+    char *end = digits + sizeof(digits), *at = end;
+    while(magnitude >= 100) {
+        at -= 2;
+        memcpy(at, cli_digit_pairs + (magnitude % 100) * 2, 2);
+        magnitude /= 100;
+    }
+    if(magnitude >= 10) {
+        at -= 2;
+        memcpy(at, cli_digit_pairs + magnitude * 2, 2);
+    } else {
+        *--at = (char)('0' + magnitude);
+    }
+
+    if(value < 0) *out++ = '-';
+    memcpy(out, at, (size_t)(end - at));
+    out += end - at;
+    *out++ = '\n';
+    return out;
+}
+
+static bool cli_reserve(CliBuffer *buffer, size_t more) {
+    if(buffer->size + more <= buffer->capacity) return true;
+
+    size_t capacity = buffer->capacity;
+    while(buffer->size + more > capacity) capacity = capacity == 0 ? 65536 : capacity * 2;
+    char *data = realloc(buffer->data, capacity);
+    if(data == NULL) {
+        buffer->out_of_memory = true;
+        return false;
+    }
+
+    buffer->data     = data;
+    buffer->capacity = capacity;
+    return true;
+}
+
+static void cli_roll_block(void *user, Rng *stream, size_t block, size_t count) {
+    CliRound  *round  = user;
+    CliBuffer *buffer = &round->buffers[block];
+    buffer->size = 0;
+
+    int64_t values[1024];
+    for(size_t done = 0; done < count; ) {
+        size_t batch = count - done < 1024 ? count - done : 1024;
+        expr_eval_batch(round->expr, stream, values, batch);
+        done += batch;
+
+        switch(round->format) {
+            case CLI_FORMAT_BIN:
+                if(!cli_reserve(buffer, batch * sizeof(int64_t))) return;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+                for(size_t i = 0; i < batch; i++) values[i] = (int64_t)__builtin_bswap64((uint64_t)values[i]);
+#endif
+                memcpy(buffer->data + buffer->size, values, batch * sizeof(int64_t));
+                buffer->size += batch * sizeof(int64_t);
+                break;
+
+            case CLI_FORMAT_CSV: {
+                if(!cli_reserve(buffer, batch * CLI_MAX_LINE)) return;
+                char *out = buffer->data + buffer->size;
+                for(size_t i = 0; i < batch; i++) out = cli_format_line(out, values[i]);
+                buffer->size = (size_t)(out - buffer->data);
+            } break;
+
+            case CLI_FORMAT_HIST:
+                for(size_t i = 0; i < batch; i++) {
+                    if(!mc_histogram_add(&round->histograms[block], values[i])) {
+                        round->too_wide[block] = true;
+                        return;
+                    }
+                }
+                break;
+        }
+    }
+}
+
+static bool cli_write(const char *data, size_t size) {
+    while(size > 0) {
+        ssize_t written = write(STDOUT_FILENO, data, size);
+        if(written < 0) {
+            if(errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        size -= (size_t)written;
+    }
+    return true;
+}
+
+static void *cli_writer(void *arg) {
+    CliWriter *writer = arg;
+    for(size_t b = 0; b < writer->count && !writer->failed; b++)
+        writer->failed = !cli_write(writer->buffers[b].data, writer->buffers[b].size);
+    return NULL;
+}
+
+// Every thread gets a few output buffers of a block each, past a few threads per core
+// more only cost memory
+#define CLI_THREADS_PER_CPU 4
+
+static void cli_usage(void) {
+    fprintf(stderr, "usage: dice --roll ROLL [--count N] [--format bin|csv|hist] [--seed N] [--threads N] [--stats]\n");
+}
+
+// Counts like 1e9 are allowed as long as they come out whole
+static bool cli_parse_count(const char *text, uint64_t *count) {
+    char  *end;
+    double value = strtod(text, &end);
+    if(end == text || *end != '\0' || !(value >= 0.0) || value >= 18446744073709551616.0 || value != (double)(uint64_t)value) return false;
+    *count = (uint64_t)value;
+    return true;
+}
+
+// Seeds are taken exactly, a double would round the ones past 2^53
+static bool cli_parse_seed(const char *text, uint64_t *seed) {
+    if(*text < '0' || *text > '9') return false; // strtoull would skip spaces and negate on a '-'
+
+    char *end;
+    errno = 0;
+    unsigned long long value = strtoull(text, &end, 10);
+    if(errno != 0 || *end != '\0') return false;
+    *seed = value;
+    return true;
+}
+
+bool cli_wanted(int argc, char **argv) {
+    for(int a = 1; a < argc; a++)
+        if(strcmp(argv[a], "--roll") == 0) return true;
+    return false;
+}
+
+int cli_run(int argc, char **argv) {
+    const char *text    = NULL;
+    uint64_t    count   = 1;
+    uint64_t    seed    = (uint64_t)time(NULL);
+    uint64_t    threads = 0; // all cores unless asked for
+    CliFormat   format  = CLI_FORMAT_CSV;
+    bool        stats   = false;
+
+    for(int a = 1; a < argc; a++) {
+        const char *option = argv[a];
+        const char *value  = a + 1 < argc ? argv[a + 1] : NULL;
+        bool        valid  = value != NULL;
+
+        if(strcmp(option, "--stats") == 0) {
+            stats = true;
+            continue;
+        }
+
+        if(strcmp(option, "--roll") == 0)         text  = value;
+        else if(strcmp(option, "--count") == 0)   valid = valid && cli_parse_count(value, &count);
+        else if(strcmp(option, "--seed") == 0)    valid = valid && cli_parse_seed(value, &seed);
+        else if(strcmp(option, "--threads") == 0) valid = valid && cli_parse_count(value, &threads) && threads > 0;
+        else if(strcmp(option, "--format") == 0) {
+            if(valid && strcmp(value, "bin") == 0)       format = CLI_FORMAT_BIN;
+            else if(valid && strcmp(value, "csv") == 0)  format = CLI_FORMAT_CSV;
+            else if(valid && strcmp(value, "hist") == 0) format = CLI_FORMAT_HIST;
+            else                                         valid  = false;
+        } else {
+            fprintf(stderr, "dice: unknown option '%s'\n", option);
+            cli_usage();
+            return 2;
+        }
+
+        if(!valid) {
+            fprintf(stderr, "dice: %s needs a valid value\n", option);
+            cli_usage();
+            return 2;
+        }
+        a++;
+    }
+
+    Expr      expr;
+    ExprError error;
+    if(!expr_compile(&expr, text, &error)) {
+        fprintf(stderr, "dice: %s at %zu in '%s'\n", error.message, error.position + 1, text);
+        return 2;
+    }
+
+    long     cpu_count   = sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t cpus        = cpu_count > 0 ? (uint64_t)cpu_count : 1;
+    uint64_t max_threads = cpus * CLI_THREADS_PER_CPU < RNG_MAX_THREADS ? cpus * CLI_THREADS_PER_CPU : RNG_MAX_THREADS;
+    if(threads == 0)          threads = cpus;
+    if(threads > max_threads) threads = max_threads;
+
+    Rng rng;
+    rng_seed(&rng, seed);
+
+    // A few blocks per thread per round, and two rounds of buffers so one can be
+    // written while the other fills
+    size_t       round_blocks = 4 * (size_t)threads;
+    CliBuffer   *buffers      = calloc(2 * round_blocks, sizeof(*buffers));
+    McHistogram *histograms   = calloc(round_blocks, sizeof(*histograms));
+    bool        *too_wide     = calloc(round_blocks, sizeof(*too_wide));
+    CliWriter    writer       = {0};
+    bool         writing      = false;
+    bool         failed       = false;
+
+    if(buffers == NULL || histograms == NULL || too_wide == NULL) {
+        fprintf(stderr, "dice: out of memory for %zu output buffers\n", 2 * round_blocks);
+        free(buffers);
+        free(histograms);
+        free(too_wide);
+        expr_free(&expr);
+        return 1;
+    }
+
+    CliRound round = { .expr = &expr, .format = format, .histograms = histograms, .too_wide = too_wide };
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    uint64_t made = 0, bytes = 0;
+    for(size_t r = 0; made < count && !failed; r++) {
+        uint64_t left   = count - made;
+        size_t   values = left < (uint64_t)round_blocks * RNG_BLOCK ? (size_t)left : round_blocks * RNG_BLOCK;
+
+        round.buffers = buffers + (r % 2) * round_blocks;
+        rng_run_blocks(&rng, values, (size_t)threads, cli_roll_block, &round);
+        made += values;
+
+        for(size_t b = 0; b < round_blocks && !failed; b++) {
+            if(too_wide[b]) {
+                fprintf(stderr, "dice: results spread over too many values to count\n");
+                failed = true;
+            } else if(round.buffers[b].out_of_memory) {
+                fprintf(stderr, "dice: out of memory for the output of a block\n");
+                failed = true;
+            }
+        }
+
+        if(writing) {
+            pthread_join(writer.thread, NULL);
+            writing = false;
+            if(writer.failed) failed = true;
+        }
+        if(failed || format == CLI_FORMAT_HIST) continue;
+
+        writer  = (CliWriter){ .buffers = round.buffers, .count = (values + RNG_BLOCK - 1) / RNG_BLOCK };
+        for(size_t b = 0; b < writer.count; b++) bytes += writer.buffers[b].size;
+        writing = pthread_create(&writer.thread, NULL, cli_writer, &writer) == 0;
+        if(!writing) {
+            cli_writer(&writer);
+            failed = writer.failed;
+        }
+    }
+
+    if(writing) {
+        pthread_join(writer.thread, NULL);
+        if(writer.failed) failed = true;
+    }
+
+    if(!failed && format == CLI_FORMAT_HIST) {
+        McHistogram total = {0};
+        for(size_t b = 0; b < round_blocks && !failed; b++) failed = !mc_histogram_merge(&total, &histograms[b]);
+        if(failed) fprintf(stderr, "dice: results spread over too many values to count\n");
+
+        CliBuffer buffer = {0};
+        for(size_t i = 0; i < total.count && !failed; i++) {
+            if(total.counts[i] == 0) continue;
+
+            if(!cli_reserve(&buffer, 2 * CLI_MAX_LINE)) {
+                fprintf(stderr, "dice: out of memory for the histogram output\n");
+                failed = true;
+                break;
+            }
+            char *out = cli_format_line(buffer.data + buffer.size, total.min + (int64_t)i);
+            out[-1] = ',';
+            out = cli_format_line(out, (int64_t)total.counts[i]);
+            buffer.size = (size_t)(out - buffer.data);
+
+            if(buffer.size > 65536) {
+                failed = !cli_write(buffer.data, buffer.size);
+                bytes += buffer.size;
+                buffer.size = 0;
+            }
+        }
+        if(!failed) {
+            failed = !cli_write(buffer.data, buffer.size);
+            bytes += buffer.size;
+        }
+
+        free(buffer.data);
+        mc_histogram_free(&total);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if(stats) {
+        double seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) * 1e-9;
+        fprintf(stderr, "dice: %llu rolls of '%s' in %.3f s on %llu threads, %.1f M rolls/s, %.1f MB/s written\n", (unsigned long long)made,
+            text, seconds, (unsigned long long)threads, (double)made / seconds / 1e6, (double)bytes / seconds / 1e6);
+    }
+
+    for(size_t b = 0; b < 2 * round_blocks; b++) free(buffers[b].data);
+    for(size_t b = 0; b < round_blocks; b++) mc_histogram_free(&histograms[b]);
+    free(buffers);
+    free(histograms);
+    free(too_wide);
+    expr_free(&expr);
+    return failed ? 1 : 0;
+}
+
+#endif // CLI_IMPLEMENTATION
@@ -5,10 +5,13 @@
 #include <string.h>
 #include <math.h>
 #include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #include "logka.h"
 #include "raylib.h"
 #include "raymath.h"
+#include "rlgl.h"
 
 #include "microui.h"
 #include "murl.h"
@@ -19,15 +22,51 @@
 #define NOB_IMPLEMENTATION
 #include "nob.h"
 
+#define RNG_IMPLEMENTATION
+#include "rng.h"
+
+#define KERNELS_IMPLEMENTATION
+#include "kernels.h"
+
+#define POOL_IMPLEMENTATION
+#include "pool.h"
+
+#define DIST_IMPLEMENTATION
+#include "dist.h"
+
+#define EXPR_IMPLEMENTATION
+#include "expr.h"
+
+#define MC_IMPLEMENTATION
+#include "montecarlo.h"
+
+#define CLI_IMPLEMENTATION
+#include "cli.h"
+
+#define MACRO_IMPLEMENTATION
+#include "macro.h"
+
+#define GRID_IMPLEMENTATION
+#include "grid.h"
+
 #define TUTORIAL_TEXT "Press space to add a dice\n" \
                       "     ctrl to roll the dice"
 #define TUTORIAL_TEXT_SIZE 48
 
 static bool is_sorting  = false;
+static bool is_packing  = false;
 
 static char threshold_buffer[32] = {"3"};
 static int  threshold_number     =   3;
 
+static char successes_buffer[32] = {"1"};
+static int  successes_number     =   1;
+
+// From this many dice on the dice area shows how many of each face came up instead
+// of the dice, which only needs the pool's face counts
+static char chart_buffer[32] = {"100000"};
+static int  chart_from       =  100000;
+
 static Font font_small; /* 16 */
 static Font font_big;   /* 64 */
 
@@ -35,38 +74,152 @@ static Font font_big;   /* 64 */
 
 static float wiggle_timer = MAX_WIGGLE_TIME + 1.0f;
 
-static Sound dice_sound;
-static Sound click_sound;
-
-typedef struct DiceRoll {
-    uint32_t amount;
-    uint32_t dice_sides;
-} DiceRoll;
-
-typedef struct Macro {
-    DiceRoll roll;
-    char *name;
-} Macro;
-
-typedef struct MacroList {
-    Macro  *items;
-    size_t count;
-    size_t capacity;
-} MacroList;
+// After this long with nothing moving and no input the loop sleeps until the next
+// event instead of drawing the same frame 30 times a second. The delay lets microui
+// settle hover states and the like before it stops.
+#define IDLE_AFTER_SECONDS 0.5
 
-static MacroList macro_list = {0};
+typedef struct RedrawState {
+    bool     waiting;         // event waiting is on, so the last frame ended in a wait
+    double   last_activity;
+    uint64_t pool_generation; // dice the last frame showed
+} RedrawState;
 
-typedef struct Die {
-    uint8_t value;
-} Die;
+static RedrawState redraw = {0};
 
-#define MAX_DICE 1024
-
-static Die    dice_buffer[MAX_DICE] = {0};
-static size_t dice_count            =  0;
+static Sound dice_sound;
+static Sound click_sound;
 
-#define DICE_TEXTURE_COUNT 6
-static Texture dice_textures[DICE_TEXTURE_COUNT] = {0};
+static MacroTable macro_table = {0};
+
+// Dice term distributions shared by every macro in macro_table
+static ExprDistCache macro_dists = {0};
+
+static char macro_result[256] = {0}; // what the last macro that was clicked rolled
+
+// Macros without an exact distribution get one sampled until every P(>= x) is known
+// to within this, or until the cap, whichever comes first
+#define MACRO_ESTIMATE_WIDTH   0.005
+#define MACRO_ESTIMATE_SAMPLES (1 << 24)
+
+// Sampling can take seconds, so it runs on a thread of its own, one macro at a time.
+// The frame after it is done hands the result to the macro, if it is still there.
+typedef struct MacroEstimate {
+    pthread_t   thread;
+    bool        running;  // started and not joined yet
+    atomic_bool done;
+    MacroHandle macro;
+    Expr        expr;     // a copy, the macro can be removed while it samples
+    McConfig    config;
+    McResult    result;
+    bool        ok;
+    const char *error;
+} MacroEstimate;
+
+static MacroEstimate macro_estimate = {0};
+
+// The last macro that was clicked and what it rolled, kept to fill in the odds once
+// an estimate for it comes in
+static MacroHandle macro_result_handle = { .slot = MACRO_NONE };
+static int64_t     macro_result_value  = 0;
+
+// Text box contents with a counter that goes up on every edit, so whatever is worked
+// out from the text only has to be redone when the generation moved on
+typedef struct EditBuffer {
+    char     text[1024];
+    uint32_t generation;
+} EditBuffer;
+
+static EditBuffer macro_roll_buffer = { .text = "12d6" };
+
+// The roll being typed in, compiled with the labels and odds the panel shows for it
+static Expr     macro_roll            = {0};
+static bool     macro_roll_valid      = false;
+static char     macro_roll_label[128] = {0};
+static char     macro_roll_odds[128]  = {0};
+static DiceDist macro_roll_dist       = {0};
+static bool     macro_roll_has_dist   = false;
+static uint32_t macro_roll_generation = UINT32_MAX; // what the above was made for
+
+static DicePool dice_pool = { .threshold = 3 };
+
+static Rng    rng          = {0};
+static size_t roll_threads =  1;
+
+// From this many dice on a roll only draws how many of each face came up, the dice
+// themselves are written out once they get drawn
+#define HISTOGRAM_ROLL_THRESHOLD (1 << 20)
+
+// All faces live side by side in one texture so the whole grid draws as a single
+// batch instead of switching textures between every pair of different dice
+#define DICE_FACE_COUNT 6
+#define DICE_ATLAS_GAP  2 // keeps filtering from pulling in the neighbouring face
+static Texture   dice_atlas                  = {0};
+static Rectangle dice_faces[DICE_FACE_COUNT] = {0};
+
+// From this many dice on screen the grid is drawn instanced, below it rebuilding the
+// instance buffer on every roll costs more than the quads it saves
+#define GRID_INSTANCED_MIN 2048
+
+#define DICE_SIZE 128.0f
+
+// The dice area is a camera over the grid, scrolled with the wheel and zoomed with
+// shift and the wheel
+#define DICE_ZOOM_MIN  (1.0f / 32)
+#define DICE_ZOOM_MAX  2.0f
+#define DICE_ZOOM_STEP 1.25f
+
+static float  dice_zoom   = 1.0f;
+static double dice_scroll = 0.0; // grid y at the top of the dice area
+
+static GridLayout    dice_layout            = {0};
+static GridRenderer  dice_grid              = {0};
+static uint8_t      *grid_values            = NULL;
+static size_t        grid_values_capacity   = 0;
+static size_t        grid_values_first      = 0;
+static size_t        grid_values_count      = 0;
+static uint64_t      grid_values_generation = UINT64_MAX; // pool generation the GPU copy holds
+static uint64_t      grid_layout_version    = UINT64_MAX; // layout version the GPU copy holds
+
+// Shown with F3
+typedef struct FrameStats {
+    bool   visible;
+    float  frame_ms;     // smoothed
+    float  frame_ms_max; // worst frame of the last second
+    float  window_ms;    // how much of that second has passed
+    float  window_max;
+    size_t grid_quads;
+    size_t grid_draw_calls;
+    size_t grid_face_runs; // draw calls the grid took before the atlas
+    bool   grid_instanced;
+} FrameStats;
+
+static FrameStats frame_stats = {0};
+
+// Past this many dice the exact sum distribution takes longer than a frame to
+// compute and is indistinguishable from the normal approximation anyway
+#define SUM_DIST_EXACT_MAX 20000
+
+// Same for the success count distribution, which is cheaper per die
+#define SUCCESS_DIST_EXACT_MAX 1000000
+
+// Exact pool distributions are kept by what they were computed for, so adding and
+// removing a die or going back to a threshold does not compute them again. The least
+// recently used go once there are too many of them or they hold too many values.
+#define POOL_DIST_CACHE_ENTRIES 16
+#define POOL_DIST_CACHE_VALUES  (1 << 21)
+
+typedef struct PoolDist {
+    DiceDist dist;
+    size_t   amount;
+    uint32_t sides;
+    int      threshold; // 0 for the sum
+    uint64_t last_used;
+} PoolDist;
+
+static PoolDist pool_dists[POOL_DIST_CACHE_ENTRIES];
+static size_t   pool_dist_count = 0;
+static uint64_t pool_dist_clock = 0;
 
 int get_executable_path(char *buffer, unsigned int buffer_size) {
 	#if defined(__linux__)
@@ -87,7 +240,7 @@ int get_executable_path(char *buffer, unsigned int buffer_size) {
 	return 0;
 }
 
-bool load_texture_from_asset_package(Texture *texture, qop_desc *qop, const char *filename) {
+bool load_image_from_asset_package(Image *image, qop_desc *qop, const char *filename) {
     qop_file *file = qop_find(qop, filename);
 	if(file == NULL) {
 	    error("QOP failed to find file '%s' while trying to load an image", filename);
@@ -98,21 +251,49 @@ bool load_texture_from_asset_package(Texture *texture, qop_desc *qop, const char
 
 	qop_read(qop, file, contents);
 
-    Image image = LoadImageFromMemory(".png", contents, file->size);
+    *image = LoadImageFromMemory(".png", contents, file->size);
+    free(contents);
 
-    if(!IsImageValid(image)) {
+    if(!IsImageValid(*image)) {
         error("Tried loading image '%s' from QOP but it was invalid", filename);
         return false;
     }
 
-    *texture = LoadTextureFromImage(image);
-    if(!IsTextureValid(*texture)) {
-        error("While attempting to upload the data of '%s' as a texture, an error occured. Check the raylib logs.", filename);
+    return true;
+}
+
+bool load_dice_atlas(qop_desc *qop) {
+    Image faces[DICE_FACE_COUNT] = {0};
+    int width  = 0;
+    int height = 0;
+
+    for(int i = 0; i < DICE_FACE_COUNT; i++) {
+        if(!load_image_from_asset_package(&faces[i], qop, TextFormat("assets/dots_%d.png", i + 1))) {
+            for(int j = 0; j < i; j++) UnloadImage(faces[j]);
+            return false;
+        }
+        width += faces[i].width + (i > 0 ? DICE_ATLAS_GAP : 0);
+        if(faces[i].height > height) height = faces[i].height;
+    }
+
+    Image atlas = GenImageColor(width, height, BLANK);
+    int x = 0;
+    for(int i = 0; i < DICE_FACE_COUNT; i++) {
+        dice_faces[i] = (Rectangle){ (float)x, 0.0f, (float)faces[i].width, (float)faces[i].height };
+        ImageDraw(&atlas, faces[i], (Rectangle){ 0, 0, faces[i].width, faces[i].height }, dice_faces[i], WHITE);
+        x += faces[i].width + DICE_ATLAS_GAP;
+        UnloadImage(faces[i]);
+    }
+
+    dice_atlas = LoadTextureFromImage(atlas);
+    UnloadImage(atlas);
+
+    if(!IsTextureValid(dice_atlas)) {
+        error("While attempting to upload the dice atlas as a texture, an error occured. Check the raylib logs.");
         return false;
     }
 
-    UnloadImage(image);
-    free(contents);
+    debug("packed %d dice faces into a %dx%d atlas", DICE_FACE_COUNT, width, height);
 
     return true;
 }
@@ -172,12 +353,7 @@ bool load_assets(void) {
         return false;
     }
 
-    if(!load_texture_from_asset_package(&dice_textures[0], &qop, "assets/dots_1.png")) return false;
-    if(!load_texture_from_asset_package(&dice_textures[1], &qop, "assets/dots_2.png")) return false;
-    if(!load_texture_from_asset_package(&dice_textures[2], &qop, "assets/dots_3.png")) return false;
-    if(!load_texture_from_asset_package(&dice_textures[3], &qop, "assets/dots_4.png")) return false;
-    if(!load_texture_from_asset_package(&dice_textures[4], &qop, "assets/dots_5.png")) return false;
-    if(!load_texture_from_asset_package(&dice_textures[5], &qop, "assets/dots_6.png")) return false;
+    if(!load_dice_atlas(&qop)) return false;
 
     if(!load_sound_from_asset_package(&dice_sound,  &qop, "assets/dice-1.wav"))  return false;
     if(!load_sound_from_asset_package(&click_sound, &qop, "assets/click_2.wav")) return false;
@@ -189,92 +365,387 @@ bool load_assets(void) {
     return true;
 }
 
-bool parse_dice_roll(const char *text, DiceRoll *roll) {
-    char *text_cursor = (char *)text;
-
-    char   number_buffer[128]   = {0};
-    size_t number_buffer_cursor =  0;
-
-    for(char c = *text_cursor; c >= '0' && c <= '9'; c = *(++text_cursor)) {
-        if(c == '\0')                   return false;
-        if(number_buffer_cursor >= 127) return false;
-        if(c == 'd')                    break;
-        number_buffer[number_buffer_cursor++] = c;
+// Distribution of the sum of amount dice, or of how many reach threshold when it is set
+const DiceDist *pool_dist(size_t amount, uint32_t sides, int threshold) {
+    pool_dist_clock++;
+    for(size_t i = 0; i < pool_dist_count; i++) {
+        PoolDist *entry = &pool_dists[i];
+        if(entry->amount != amount || entry->sides != sides || entry->threshold != threshold) continue;
+        entry->last_used = pool_dist_clock;
+        return &entry->dist;
     }
 
-    if(number_buffer_cursor == 0) return false;
+    DiceDist dist = {0};
+    if(threshold == 0) dist_dice_sum(&dist, amount, sides);
+    else               dist_successes(&dist, amount, (double)(sides - threshold + 1) / (double)sides);
 
-    roll->amount = atoi(number_buffer);
-    number_buffer_cursor = 0;
-    memset(number_buffer, 0, 128);
+    size_t values = dist.count;
+    for(size_t i = 0; i < pool_dist_count; i++) values += pool_dists[i].dist.count;
 
-    text_cursor += 1; // skip the 'd'
+    while(pool_dist_count > 0 && (pool_dist_count == POOL_DIST_CACHE_ENTRIES || values > POOL_DIST_CACHE_VALUES)) {
+        size_t oldest = 0;
+        for(size_t i = 1; i < pool_dist_count; i++)
+            if(pool_dists[i].last_used < pool_dists[oldest].last_used) oldest = i;
 
-    for(char c = *text_cursor; c >= '0' && c <= '9'; c = *(++text_cursor)) {
-        if(number_buffer_cursor >= 127) return false;
-        if(c == '\0')                   break;
-        number_buffer[number_buffer_cursor++] = c;
+        values -= pool_dists[oldest].dist.count;
+        dist_free(&pool_dists[oldest].dist);
+        pool_dists[oldest] = pool_dists[--pool_dist_count];
     }
 
-    if(number_buffer_cursor == 0) return false;
+    PoolDist *entry = &pool_dists[pool_dist_count++];
+    *entry = (PoolDist){ .dist = dist, .amount = amount, .sides = sides, .threshold = threshold, .last_used = pool_dist_clock };
+    return &entry->dist;
+}
 
-    roll->dice_sides = atoi(number_buffer);
+double sum_at_least_probability(uint64_t sum) {
+    uint32_t sides = DICE_FACE_COUNT;
 
-    return true;
+    if(dice_pool.count > SUM_DIST_EXACT_MAX)
+        return dist_normal_at_least(dice_pool.count, sides, (double)sum);
+
+    return dist_at_least(pool_dist(dice_pool.count, sides, 0), (int64_t)sum);
 }
 
-bool macro_name_exists(const char *name) {
-    for(size_t i = 0; i < macro_list.count; i++)
-        if(strcmp(macro_list.items[i].name, name) == 0) return true;
+double successes_at_least_probability(uint64_t successes) {
+    uint32_t sides = DICE_FACE_COUNT;
+    double   p     = (double)(sides - threshold_number + 1) / (double)sides;
+
+    if(dice_pool.count > SUCCESS_DIST_EXACT_MAX)
+        return dist_successes_normal_at_least(dice_pool.count, p, (double)successes);
 
-    return false;
+    return dist_at_least(pool_dist(dice_pool.count, sides, threshold_number), (int64_t)successes);
 }
 
-int compare_dice(const void *dice_1, const void *dice_2) {
-    Die *d1 = (Die*)dice_1;
-    Die *d2 = (Die*)dice_2;
+int edit_textbox(mu_Context *context, EditBuffer *buffer) {
+    int result = mu_textbox(context, buffer->text, sizeof(buffer->text));
+    if(result & MU_RES_CHANGE) buffer->generation++;
+    return result;
+}
+
+void update_macro_roll(void) {
+    if(macro_roll_generation == macro_roll_buffer.generation) return;
+    macro_roll_generation = macro_roll_buffer.generation;
+
+    expr_free(&macro_roll);
+    if(macro_roll_has_dist) dist_free(&macro_roll_dist);
+    macro_roll_has_dist = false;
+    macro_roll_odds[0]  = '\0';
+
+    ExprError error;
+    macro_roll_valid = expr_compile(&macro_roll, macro_roll_buffer.text, &error);
+    if(!macro_roll_valid) {
+        snprintf(macro_roll_label, sizeof(macro_roll_label), "Invalid macro: %s at %zu", error.message, error.position + 1);
+        return;
+    }
 
-    return (int)d2->value - (int)d1->value;
+    ExprDice plain;
+    if(expr_plain_dice(&macro_roll, &plain))
+        snprintf(macro_roll_label, sizeof(macro_roll_label), "amount: %u, sides: %u", plain.amount, plain.sides);
+    else
+        snprintf(macro_roll_label, sizeof(macro_roll_label), "%zu dice terms", macro_roll.dice_count);
+
+    const char *dist_error;
+    macro_roll_has_dist = expr_distribution(&macro_roll, &macro_dists, &macro_roll_dist, &dist_error);
+    if(macro_roll_has_dist)
+        snprintf(macro_roll_odds, sizeof(macro_roll_odds), "%lld to %lld, mean %.2f", (long long)macro_roll_dist.min,
+            (long long)dist_max(&macro_roll_dist), dist_mean(&macro_roll_dist));
 }
 
 void sort_dice_if_needed(void) {
     if(is_sorting)
-        qsort(dice_buffer, dice_count, sizeof(Die), compare_dice);
+        pool_sort_descending(&dice_pool);
 }
 
-void roll_dice(void) {
-    for(size_t i = 0; i < dice_count; i++)
-        dice_buffer[i].value = GetRandomValue(1, 6);
+void roll_dice(size_t count) {
+    if(count >= HISTOGRAM_ROLL_THRESHOLD) {
+        pool_roll_histogram(&dice_pool, &rng, count, 6);
+    } else {
+        pool_resize(&dice_pool, count);
+        pool_roll(&dice_pool, &rng, 6, roll_threads);
+    }
 
     sort_dice_if_needed();
 
-    if(dice_count > 0) PlaySound(dice_sound);
+    if(dice_pool.count > 0) PlaySound(dice_sound);
 
     wiggle_timer = 0.0f;
 }
 
 void add_dice(Die die) {
-    if(dice_count >= MAX_DICE) {
-        warn("Dice count has reached the maximum amount of %d", MAX_DICE);
+    if(is_sorting) pool_insert_sorted(&dice_pool, die);
+    else           pool_push(&dice_pool, die);
+}
+
+void remove_die() {
+    pool_pop(&dice_pool, NULL);
+}
+
+// Only lays the grid out again on a resize, a new panel width, zoom or a different
+// amount of dice. The layout is in grid units, the area shrinks as the view zooms in.
+void layout_dice(Rectangle area) {
+    Rectangle grid_area = { 0.0f, 0.0f, area.width / dice_zoom, area.height / dice_zoom };
+    grid_layout_update(&dice_layout, grid_area, DICE_SIZE, dice_pool.count);
+}
+
+void update_dice_view(Rectangle area) {
+    layout_dice(area);
+
+    float wheel = GetMouseWheelMove();
+    if(wheel != 0.0f && CheckCollisionPointRec(GetMousePosition(), area)) {
+        if(IsKeyDown(KEY_LEFT_SHIFT) || IsKeyDown(KEY_RIGHT_SHIFT)) {
+            // The rows flow around the die at the top left, which stays where it is
+            size_t top_die = grid_layout_view(&dice_layout, dice_scroll).first;
+
+            dice_zoom = Clamp(dice_zoom * powf(DICE_ZOOM_STEP, wheel), DICE_ZOOM_MIN, DICE_ZOOM_MAX);
+            layout_dice(area);
+
+            size_t top_row = top_die / dice_layout.per_row;
+            dice_scroll = top_row == 0 ? 0.0 : dice_layout.bounds.y + (double)top_row * dice_layout.step;
+        } else {
+            dice_scroll -= wheel * dice_layout.step;
+        }
+    }
+
+    // The pool can shrink or the window grow under the view
+    double max_scroll = grid_layout_max_scroll(&dice_layout);
+    if(dice_scroll > max_scroll) dice_scroll = max_scroll;
+    if(dice_scroll < 0.0)        dice_scroll = 0.0;
+}
+
+// Uploads only what changed since the last frame, the positions when the layout
+// moved and the values when the dice did
+void update_grid_instances(GridView view) {
+    if(grid_layout_version != dice_layout.version) {
+        grid_renderer_upload_positions(&dice_grid, dice_layout.positions, dice_layout.slots);
+        grid_layout_version = dice_layout.version;
+    }
+
+    size_t count = view.count;
+    if(grid_values_generation == dice_pool.generation && grid_values_first == view.first &&
+       grid_values_count == count) return;
+
+    if(count > grid_values_capacity) {
+        grid_values_capacity = count;
+        grid_values = realloc(grid_values, grid_values_capacity);
+    }
+
+    for(size_t i = 0; i < count; i++) grid_values[i] = pool_get(&dice_pool, view.first + i).value;
+
+    grid_renderer_upload_values(&dice_grid, grid_values, count);
+
+    grid_values_generation = dice_pool.generation;
+    grid_values_first      = view.first;
+    grid_values_count      = count;
+}
+
+void draw_dice_quads(GridView view, Vector2 offset) {
+    size_t count = view.count;
+
+    // What the grid would cost with one texture per face: a draw call every time the
+    // face changes, against one for the whole atlas
+    size_t face_runs = 0;
+    int    last_face = -1;
+
+    for(size_t i = 0; i < count; i++) {
+        Die die = pool_get(&dice_pool, view.first + i);
+        DrawTextureRec(dice_atlas, dice_faces[die.value-1], Vector2Add(dice_layout.positions[i], offset), WHITE);
+        if(die.value != last_face) {
+            face_runs++;
+            last_face = die.value;
+        }
+    }
+
+    // rlgl also flushes whenever its vertex buffer fills up
+    size_t batch_flushes = count / RL_DEFAULT_BATCH_BUFFER_ELEMENTS;
+    frame_stats.grid_quads      = count;
+    frame_stats.grid_draw_calls = (count > 0) + batch_flushes;
+    frame_stats.grid_face_runs  = face_runs + batch_flushes;
+}
+
+// One bar per face, with the face under it when there is a texture for it
+void draw_face_chart(Rectangle area) {
+    Color ink = (Color){12, 60, 13, 255};
+
+    float padding = area.width / 20;
+    area = (Rectangle){ area.x + padding, area.y + padding, area.width - padding * 2, area.height - padding * 2 };
+
+    const char *summary = TextFormat("%llu dice   sum %llu   %llu successes",
+        (unsigned long long)dice_pool.count, (unsigned long long)dice_pool.sum, (unsigned long long)dice_pool.successes);
+    DrawTextEx(font_big, summary, (Vector2){ area.x, area.y }, 32, 1, ink);
+
+    uint32_t sides = dice_pool.sides > 0 ? dice_pool.sides : DICE_FACE_COUNT;
+
+    uint64_t most = 1;
+    for(uint32_t face = 1; face <= sides; face++)
+        if(dice_pool.face_counts[face] > most) most = dice_pool.face_counts[face];
+
+    float slot       = area.width / (float)sides;
+    float bar_width  = slot * 0.7f;
+    float label_size = fminf(slot * 0.7f, 64.0f);
+    float top        = area.y + 32 + 16 * 2 + 8;                   // under the summary and the count labels
+    float bottom     = area.y + area.height - label_size - 8;
+    float full       = bottom - top;
+
+    for(uint32_t face = 1; face <= sides; face++) {
+        uint64_t count  = dice_pool.face_counts[face];
+        float    height = full * (float)((double)count / (double)most);
+        float    x      = area.x + (float)(face - 1) * slot + (slot - bar_width) / 2;
+
+        DrawRectangleRec((Rectangle){ x, bottom - height, bar_width, height }, (Color){235, 235, 220, 255});
+
+        const char *label = TextFormat("%llu", (unsigned long long)count);
+        const char *share = TextFormat("%.2f%%", dice_pool.count > 0 ? (double)count / (double)dice_pool.count * 100.0 : 0.0);
+        DrawTextEx(font_small, label, (Vector2){ x, bottom - height - 16 * 2 }, 16, 1, ink);
+        DrawTextEx(font_small, share, (Vector2){ x, bottom - height - 16 },     16, 1, ink);
+
+        Vector2 corner = { x + (bar_width - label_size) / 2, bottom + 8 };
+        if(face <= DICE_FACE_COUNT) {
+            Rectangle destination = { corner.x, corner.y, label_size, label_size };
+            DrawTexturePro(dice_atlas, dice_faces[face - 1], destination, (Vector2){0}, 0.0f, WHITE);
+        } else {
+            DrawTextEx(font_small, TextFormat("%u", face), corner, 16, 1, ink);
+        }
+    }
+}
+
+void *run_macro_estimate(void *arg) {
+    MacroEstimate *estimate = arg;
+    estimate->ok = mc_run(&estimate->expr, &estimate->config, &estimate->result, &estimate->error);
+    atomic_store(&estimate->done, true);
+    return NULL;
+}
+
+// False when another macro is being sampled, it can be tried again on a later click
+bool start_macro_estimate(MacroHandle handle, const Macro *macro) {
+    if(macro_estimate.running) return false;
+
+    macro_estimate.macro  = handle;
+    macro_estimate.config = (McConfig){
+        .seed              = (uint64_t)(rng_uniform(&rng) * 9007199254740992.0),
+        .threads           = roll_threads,
+        .probability_width = MACRO_ESTIMATE_WIDTH,
+        .max_samples       = MACRO_ESTIMATE_SAMPLES,
+    };
+    expr_copy(&macro_estimate.expr, &macro->expr);
+    atomic_store(&macro_estimate.done, false);
+
+    if(pthread_create(&macro_estimate.thread, NULL, run_macro_estimate, &macro_estimate) != 0) {
+        expr_free(&macro_estimate.expr);
+        return false;
+    }
+    macro_estimate.running = true;
+    return true;
+}
+
+void format_macro_result(const Macro *macro, int64_t result) {
+    bool estimating = macro_estimate.running && macro_estimate.macro.slot == macro_result_handle.slot &&
+                      macro_estimate.macro.generation == macro_result_handle.generation;
+
+    if(macro->has_dist)
+        snprintf(macro_result, sizeof(macro_result), "%s: %lld (P(>= %lld) %s %.2f%%, mean %.2f)", macro->name,
+            (long long)result, (long long)result, macro->dist_estimated ? "~" : "=",
+            dist_at_least(&macro->dist, result) * 100.0, dist_mean(&macro->dist));
+    else if(estimating)
+        snprintf(macro_result, sizeof(macro_result), "%s: %lld (estimating odds...)", macro->name, (long long)result);
+    else if(macro->estimate_failed)
+        snprintf(macro_result, sizeof(macro_result), "%s: %lld (odds unavailable)", macro->name, (long long)result);
+    else
+        snprintf(macro_result, sizeof(macro_result), "%s: %lld", macro->name, (long long)result);
+}
+
+void finish_macro_estimate(void) {
+    if(!macro_estimate.running || !atomic_load(&macro_estimate.done)) return;
+
+    pthread_join(macro_estimate.thread, NULL);
+    macro_estimate.running = false;
+    expr_free(&macro_estimate.expr);
+
+    Macro   *macro  = macro_table_get(&macro_table, macro_estimate.macro);
+    McResult result = macro_estimate.result;
+
+    if(macro == NULL) {
+        if(macro_estimate.ok) dist_free(&result.dist);
         return;
     }
 
-    dice_buffer[dice_count++] = die;
+    bool shown = macro_result_handle.slot == macro_estimate.macro.slot && macro_result_handle.generation == macro_estimate.macro.generation;
 
-    sort_dice_if_needed();
+    // Sampling the same roll again fails the same way, so it is remembered instead of retried
+    if(!macro_estimate.ok) {
+        debug("could not sample macro '%s': %s", macro->name, macro_estimate.error);
+        macro->estimate_failed = true;
+        if(shown) format_macro_result(macro, macro_result_value);
+        return;
+    }
+
+    macro->dist     = result.dist;
+    macro->has_dist = true;
+    debug("sampled macro '%s': %llu rolls in %.3f s (%.3g/s), P(>= x) within %.4f",
+        macro->name, (unsigned long long)result.samples, result.seconds, result.samples_per_second, result.probability_width);
+
+    if(shown) format_macro_result(macro, macro_result_value);
 }
 
-void remove_die() {
-    if(dice_count == 0) return;
-    dice_count--;
-    sort_dice_if_needed();
+// Waking up from a wait means an event came in, which counts as activity as well
+void update_redraw_mode(bool woke_up) {
+    // A running estimate has to be looked at every frame to pick its result up
+    bool changed = woke_up || wiggle_timer < MAX_WIGGLE_TIME || IsWindowResized() ||
+                   dice_pool.generation != redraw.pool_generation || macro_estimate.running;
+
+    redraw.pool_generation = dice_pool.generation;
+    if(changed) redraw.last_activity = GetTime();
+
+    bool idle = GetTime() - redraw.last_activity > IDLE_AFTER_SECONDS;
+    if(idle == redraw.waiting) return;
+
+    if(idle) EnableEventWaiting();
+    else     DisableEventWaiting();
+    redraw.waiting = idle;
+}
+
+void update_frame_stats(float frame_ms) {
+    frame_stats.frame_ms = frame_stats.frame_ms == 0.0f ? frame_ms : Lerp(frame_stats.frame_ms, frame_ms, 0.1f);
+
+    if(frame_ms > frame_stats.window_max) frame_stats.window_max = frame_ms;
+    frame_stats.window_ms += frame_ms;
+    if(frame_stats.window_ms >= 1000.0f) {
+        frame_stats.frame_ms_max = frame_stats.window_max;
+        frame_stats.window_max   = 0.0f;
+        frame_stats.window_ms    = 0.0f;
+    }
+}
+
+void draw_frame_stats(void) {
+    // Fewer lines than TextFormat has buffers, so none get overwritten
+    const char *lines[] = {
+        TextFormat("frame: %.2f ms (max %.2f)", frame_stats.frame_ms, frame_stats.frame_ms_max),
+        TextFormat("dice drawn: %zu", frame_stats.grid_quads),
+        frame_stats.grid_instanced
+            ? TextFormat("grid draw calls: %zu (instanced)", frame_stats.grid_draw_calls)
+            : TextFormat("grid draw calls: %zu (%zu per face)", frame_stats.grid_draw_calls, frame_stats.grid_face_runs),
+    };
+    size_t line_count = sizeof(lines) / sizeof(lines[0]);
+
+    float width = 0.0f;
+    for(size_t i = 0; i < line_count; i++) {
+        float line_width = MeasureTextEx(font_small, lines[i], 16, 1).x;
+        if(line_width > width) width = line_width;
+    }
+
+    Vector2 corner = { GetScreenWidth() - width - 16, 8 };
+    DrawRectangle(corner.x - 8, corner.y - 4, width + 16, line_count * 20 + 8, (Color){0, 0, 0, 160});
+    for(size_t i = 0; i < line_count; i++)
+        DrawTextEx(font_small, lines[i], (Vector2){ corner.x, corner.y + i * 20 }, 16, 1, RAYWHITE);
 }
 
 extern Font get_my_epic_font_instead_of_the_default(void) {
     return font_small;
 }
 
-int main(void) {
+int main(int argc, char **argv) {
+    // Before anything logs, stdout is where the results go
+    if(cli_wanted(argc, argv)) return cli_run(argc, argv);
+
     info("Dice program started");
 
     InitWindow(1280, 720, "Dice program");
@@ -284,13 +755,19 @@ int main(void) {
 
     InitAudioDevice();
 
-    SetRandomSeed(100); // TODO: replace with time
+    rng_seed(&rng, 100); // TODO: replace with time
+
+    long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+    if(cpu_count > 1) roll_threads = (size_t)cpu_count;
 
     if(!load_assets()) {
         error("Failed to load assets");
         return 1;
     }
 
+    if(!grid_renderer_init(&dice_grid, dice_atlas, dice_faces[0], dice_faces[1].x - dice_faces[0].x))
+        info("Instanced drawing is not available, big grids are drawn die by die");
+
     SetSoundVolume(dice_sound, 0.2);
 
     SetTargetFPS(30);
@@ -303,14 +780,13 @@ int main(void) {
 
     while(!WindowShouldClose()) {
 
+        finish_macro_estimate();
+
         murl_handle_input(&mu_context);
 
         mu_begin(&mu_context);
 
-        uint32_t dice_total = 0;
-
-        for(size_t i = 0; i < dice_count; i++)
-            dice_total += dice_buffer[i].value;
+        uint64_t dice_total = dice_pool.sum;
 
         int panel_width = Clamp(GetScreenWidth() / 8, 160, 220);
 
@@ -322,17 +798,37 @@ int main(void) {
 
             mu_layout_row(&mu_context, 1, (int[]){-1}, 0);
 
-            mu_label(&mu_context, TextFormat("Dice Sum: %d", dice_total));
+            mu_label(&mu_context, TextFormat("Dice Sum: %llu", (unsigned long long)dice_total));
+            mu_label(&mu_context, TextFormat("P(sum >= %llu): %.4g%%",
+                (unsigned long long)dice_total, sum_at_least_probability(dice_total) * 100.0));
+
+            // Tiers on top of the threshold: the highest face is a critical, a 1 a fail
+            mu_label(&mu_context, TextFormat("Successes: %llu", (unsigned long long)dice_pool.successes));
+            mu_label(&mu_context, TextFormat("Crits: %llu  Fails: %llu",
+                (unsigned long long)dice_pool.face_counts[DICE_FACE_COUNT], (unsigned long long)dice_pool.face_counts[1]));
 
             mu_label(&mu_context, "");
 
-            if(mu_button(&mu_context, "Roll")) roll_dice();
+            if(mu_button(&mu_context, "Roll")) roll_dice(dice_pool.count);
 
             mu_label(&mu_context, "");
 
             if(mu_checkbox(&mu_context, "Sort dice?", (int*)&is_sorting))
                 sort_dice_if_needed();
 
+            if(mu_checkbox(&mu_context, "Pack dice?", (int*)&is_packing)) {
+                if(!pool_set_storage(&dice_pool, is_packing ? POOL_STORAGE_BASE6 : POOL_STORAGE_BYTE))
+                    is_packing = false;
+            }
+
+            mu_label(&mu_context, TextFormat("Chart from: %d dice", chart_from));
+
+            if(mu_textbox(&mu_context, chart_buffer, 32)) typing_text = true;
+
+            int chart_value = TextToInteger(chart_buffer);
+            if(chart_value > 0) chart_from = chart_value;
+            else                mu_text(&mu_context, "Please provide a positive number");
+
             mu_label(&mu_context, TextFormat("Threshold: %d", threshold_number));
 
             if(mu_textbox(&mu_context, threshold_buffer, 32)) typing_text = true;
@@ -340,15 +836,25 @@ int main(void) {
 
             int buffer_value = TextToInteger(threshold_buffer);
             if(buffer_value != 0) {
-                if(buffer_value > 6) {
+                if(buffer_value < 1 || buffer_value > 6) {
                     mu_text(&mu_context, "Please provide number between 1 and 6");
-                } else {
+                } else if(buffer_value != threshold_number) {
                     threshold_number = buffer_value;
+                    pool_set_threshold(&dice_pool, threshold_number);
                 }
             } else {
                 mu_text(&mu_context, "Please provide a valid number");
             }
 
+            mu_label(&mu_context, TextFormat("P(at least %d successes): %.4g%%",
+                successes_number, successes_at_least_probability(successes_number) * 100.0));
+
+            if(mu_textbox(&mu_context, successes_buffer, 32)) typing_text = true;
+
+            int successes_value = TextToInteger(successes_buffer);
+            if(successes_value > 0) successes_number = successes_value;
+            else                    mu_text(&mu_context, "Please provide a positive number");
+
             { // Menu for adding macros
                 mu_label(&mu_context, "");
                 mu_label(&mu_context, "Define macros:");
@@ -360,39 +866,82 @@ int main(void) {
                 if(mu_textbox(&mu_context, macro_name_buffer, 1024)) typing_text = true;
 
                 mu_label(&mu_context, "roll");
-                static char macro_roll_buffer[1024] = "12d6";
-                if(mu_textbox(&mu_context, macro_roll_buffer, 1024)) typing_text = true;
-
-                DiceRoll roll;
-                bool roll_text_valid = parse_dice_roll(macro_roll_buffer, &roll);
+                if(edit_textbox(&mu_context, &macro_roll_buffer)) typing_text = true;
+                update_macro_roll();
 
                 mu_layout_row(&mu_context, 1, (int[]){-1}, 0);
-                if(roll_text_valid) {
-                    mu_label(&mu_context, TextFormat("amount: %d, sides: %d", roll.amount, roll.dice_sides));
-                } else {
-                    mu_label(&mu_context, "Invalid macro");
-                }
+                mu_label(&mu_context, macro_roll_label);
+                if(macro_roll_odds[0] != '\0') mu_label(&mu_context, macro_roll_odds);
 
                 static char *error_text = "no_error";
 
                 if(mu_button(&mu_context, "make macro")) {
-                    if(!roll_text_valid || strlen(macro_name_buffer) < 1) {
+                    if(!macro_roll_valid || strlen(macro_name_buffer) < 1) {
                         debug("attempted to create macro with invalid name '%s'", macro_name_buffer);
                         error_text = "please use a valid name";
                         mu_open_popup(&mu_context, "Error");
-                    } else if(macro_name_exists(macro_name_buffer)) {
+                    } else if(macro_table_find(&macro_table, macro_name_buffer, NULL)) {
                         debug("attempted to create macro with existing name '%s'", macro_name_buffer);
                         error_text = "Macro name already exists";
                         mu_open_popup(&mu_context, "Error");
                     } else {
-                        Macro new_macro = (Macro) {
-                            .roll = roll,
-                            .name = strdup(macro_name_buffer)
-                        };
-                        nob_da_append(&macro_list, new_macro);
+                        // The macro gets its own copy of what the preview already worked out
+                        Expr        roll;
+                        MacroHandle handle;
+                        expr_copy(&roll, &macro_roll);
+                        macro_table_add(&macro_table, macro_name_buffer, macro_roll_buffer.text, &roll, &handle);
+
+                        Macro *new_macro = macro_table_get(&macro_table, handle);
+                        new_macro->dist_checked = macro_roll_has_dist;
+                        new_macro->has_dist     = macro_roll_has_dist;
+                        if(macro_roll_has_dist) dist_copy(&new_macro->dist, &macro_roll_dist);
                     }
                 }
 
+                { // Saving and loading the macros, binary files for keeping and text to edit
+                    mu_layout_row(&mu_context, 2, (int[]){50, -1}, 0);
+                    mu_label(&mu_context, "file");
+                    static char macro_file_buffer[1024] = "macros.dmac";
+                    if(mu_textbox(&mu_context, macro_file_buffer, 1024)) typing_text = true;
+
+                    mu_layout_row(&mu_context, 2, (int[]){panel_width / 2 - 8, -1}, 0);
+                    static char macro_file_status[256] = {0};
+                    MacroFileReport report = {0};
+
+                    if(mu_button(&mu_context, "save")) {
+                        if(macro_table_save(&macro_table, macro_file_buffer))
+                            snprintf(macro_file_status, sizeof(macro_file_status), "saved %zu macros", macro_table.count);
+                        else
+                            snprintf(macro_file_status, sizeof(macro_file_status), "could not write %.200s", macro_file_buffer);
+                    }
+                    if(mu_button(&mu_context, "load")) {
+                        if(!macro_table_load(&macro_table, macro_file_buffer, &report))
+                            snprintf(macro_file_status, sizeof(macro_file_status), "%.200s is not a macro file", macro_file_buffer);
+                        else
+                            snprintf(macro_file_status, sizeof(macro_file_status), "loaded %zu, %zu names taken, %zu broken",
+                                report.added, report.duplicates, report.invalid);
+                    }
+                    if(mu_button(&mu_context, "import")) {
+                        if(!macro_table_import(&macro_table, macro_file_buffer, &report))
+                            snprintf(macro_file_status, sizeof(macro_file_status), "could not read %.200s", macro_file_buffer);
+                        else if(report.invalid > 0)
+                            snprintf(macro_file_status, sizeof(macro_file_status), "imported %zu, %zu names taken, %zu bad lines from line %zu",
+                                report.added, report.duplicates, report.invalid, report.first_invalid_line);
+                        else
+                            snprintf(macro_file_status, sizeof(macro_file_status), "imported %zu, %zu names taken",
+                                report.added, report.duplicates);
+                    }
+                    if(mu_button(&mu_context, "export")) {
+                        if(macro_table_export(&macro_table, macro_file_buffer))
+                            snprintf(macro_file_status, sizeof(macro_file_status), "exported %zu macros", macro_table.count);
+                        else
+                            snprintf(macro_file_status, sizeof(macro_file_status), "could not write %.200s", macro_file_buffer);
+                    }
+
+                    mu_layout_row(&mu_context, 1, (int[]){-1}, 0);
+                    if(macro_file_status[0] != '\0') mu_label(&mu_context, macro_file_status);
+                }
+
                 if (mu_begin_popup(&mu_context, "Error")) {
                     int error_text_width = MeasureTextEx(font_small, error_text, font_small.baseSize, 1).x + 10;
                     mu_layout_row(&mu_context, 1, (int[]) { error_text_width }, 0);
@@ -400,26 +949,53 @@ int main(void) {
                     mu_end_popup(&mu_context);
                 }
 
-                if(macro_list.count > 0)
+                if(macro_table.count > 0)
                     mu_label(&mu_context, "macros:");
 
                 mu_layout_row(&mu_context, 2, (int[]) { panel_width * 0.8, -1 }, 0);
-                for(size_t i = 0; i < macro_list.count; i++) {
-                    Macro it = macro_list.items[i];
-                    if(mu_button(&mu_context, TextFormat("%s(%dd%d)", it.name, it.roll.amount, it.roll.dice_sides))) {
-                        dice_count = it.roll.amount;
-                        roll_dice();
-                    }
+                MacroHandle handle;
+                for(bool more = macro_table_first(&macro_table, &handle); more; ) {
+                    MacroHandle current = handle;
+                    more = macro_table_next(&macro_table, &handle); // before current can be removed
+
+                    Macro *it = macro_table_get(&macro_table, current);
+                    if(mu_button(&mu_context, TextFormat("%s(%s)", it->name, it->text))) {
+                        // Worked out on first use, a freshly loaded library can hold more
+                        // macros than anyone clicks
+                        if(!it->dist_checked) {
+                            const char *dist_error;
+                            it->dist_checked = true;
+                            it->has_dist     = expr_distribution(&it->expr, &macro_dists, &it->dist, &dist_error);
+                            if(!it->has_dist) debug("no exact distribution for macro '%s': %s", it->name, dist_error);
+                        }
 
-                    if(mu_button(&mu_context, TextFormat("X#%zu", i))) {
-                        if(i + 1 == macro_list.count) {
-                            macro_list.count -= 1;
+                        // Set while it samples so it is not started twice
+                        if(!it->has_dist && !it->dist_estimated && !it->estimate_failed)
+                            it->dist_estimated = start_macro_estimate(current, it);
+
+                        // Plain d6 rolls still go into the pool to be looked at, anything
+                        // else only has a result
+                        ExprDice plain;
+                        int64_t  result;
+                        if(expr_plain_dice(&it->expr, &plain) && plain.sides == DICE_FACE_COUNT) {
+                            roll_dice(plain.amount);
+                            result = (int64_t)dice_pool.sum;
                         } else {
-                            free(macro_list.items[i].name);
-                            memmove(&macro_list.items[i], &macro_list.items[i+1], (macro_list.count - 1 - i) * sizeof(Macro));
-                            macro_list.count -= 1;
+                            result = expr_eval(&it->expr, &rng);
                         }
+
+                        macro_result_handle = current;
+                        macro_result_value  = result;
+                        format_macro_result(it, result);
                     }
+
+                    if(mu_button(&mu_context, TextFormat("X#%u", current.slot)))
+                        macro_table_remove(&macro_table, current);
+                }
+
+                if(macro_result[0] != '\0') {
+                    mu_layout_row(&mu_context, 1, (int[]){-1}, 0);
+                    mu_label(&mu_context, macro_result);
                 }
             }
             mu_end_window(&mu_context);
@@ -429,18 +1005,20 @@ int main(void) {
 
         if(!typing_text) {
             if(IsKeyPressed(KEY_SPACE)) {
-                add_dice((Die){ .value = GetRandomValue(1, 6) });
+                add_dice((Die){ .value = rng_range(&rng, 6) });
                 PlaySound(click_sound);
             }
 
             if(IsKeyPressed(KEY_LEFT_CONTROL))
-                roll_dice();
+                roll_dice(dice_pool.count);
 
             if(IsKeyPressed(KEY_D)) {
                 remove_die();
                 PlaySound(click_sound);
             }
 
+            if(IsKeyPressed(KEY_F3)) frame_stats.visible = !frame_stats.visible;
+
             if(IsKeyPressed(KEY_S)) {
                 is_sorting = !is_sorting;
                 sort_dice_if_needed();
@@ -450,7 +1028,19 @@ int main(void) {
         BeginDrawing();
         ClearBackground((Color){23, 100, 56, 255});
 
-        if(dice_count == 0) {
+        frame_stats.grid_quads      = 0;
+        frame_stats.grid_draw_calls = 0;
+        frame_stats.grid_face_runs  = 0;
+        frame_stats.grid_instanced  = false;
+
+        Rectangle dice_area = {
+            .x      = (float)panel_width,
+            .y      = 0.0f,
+            .width  = (float)(GetScreenWidth() - panel_width),
+            .height = (float)GetScreenHeight(),
+        };
+
+        if(dice_pool.count == 0) {
             Vector2 text_size = MeasureTextEx(font_big, TUTORIAL_TEXT, TUTORIAL_TEXT_SIZE, 1);
 
             Vector2 corner = (Vector2) {
@@ -459,52 +1049,61 @@ int main(void) {
             };
 
             DrawTextEx(font_big, TUTORIAL_TEXT, corner, TUTORIAL_TEXT_SIZE, 1.0, (Color){12, 60, 13, 255});
+        } else if(dice_pool.count >= (size_t)chart_from) {
+            // Drawn from the face counts alone, the dice and the view over them stay as they are
+            draw_face_chart(dice_area);
         } else {
 
-            Rectangle dice_rect = { .x = 0.0f, .y = 0.0f, .width = (float)GetScreenWidth(), .height = (float)GetScreenHeight() };
+            update_dice_view(dice_area);
 
-            dice_rect.x     += panel_width;
-            dice_rect.width -= panel_width;
-
-            float padding = dice_rect.width / 20;
+            int wiggle = 0;
 
-            dice_rect.x += padding;
-            dice_rect.y += padding;
-            dice_rect.width  -= padding * 2;
-            dice_rect.height -= padding * 2;
+            if(wiggle_timer < MAX_WIGGLE_TIME)
+                wiggle = (int)(sinf((float)GetTime() * 40) * 20 * Lerp(1.0f, 0.0f, wiggle_timer / MAX_WIGGLE_TIME));
 
-            float dice_width = 128;
+            GridView view = grid_layout_view(&dice_layout, dice_scroll);
 
-            float dice_per_row_raw = dice_rect.width / dice_width;
-            float dice_per_row     = floorf(dice_per_row_raw);
-            if (dice_per_row == 0) dice_per_row = 1;
-            float inner_padding    = (dice_per_row_raw - dice_per_row) * dice_width / (float)(dice_per_row - 1);
+            // Dice below the view are never seen, so they do not have to exist yet
+            pool_materialize(&dice_pool, view.first + view.count);
 
-            float x_cursor = dice_rect.x;
-            float y_cursor = dice_rect.y;
+            Camera2D camera = {
+                .offset = { dice_area.x, dice_area.y },
+                .target = { 0.0f, (float)(dice_scroll - view.offset) },
+                .zoom   = dice_zoom,
+            };
+            Vector2 offset = { (float)wiggle / dice_zoom, 0.0f };
 
-            int wiggle = 0;
+            BeginMode2D(camera);
 
-            if(wiggle_timer < MAX_WIGGLE_TIME)
-                wiggle = (int)(sinf((float)GetTime() * 40) * 20 * Lerp(1.0f, 0.0f, wiggle_timer / MAX_WIGGLE_TIME));
+            if(dice_grid.ready && view.count >= GRID_INSTANCED_MIN) {
+                update_grid_instances(view);
+                grid_renderer_draw(&dice_grid, offset);
 
-            for(size_t i = 0; i < dice_count; i++) {
-                Die die = dice_buffer[i];
-                DrawTexture(dice_textures[die.value-1], x_cursor + wiggle, y_cursor, WHITE);
-                if((i + 1) % (size_t)dice_per_row == 0) {
-                    x_cursor = dice_rect.x;
-                    y_cursor += dice_width + inner_padding;
-                } else {
-                    x_cursor += dice_width + inner_padding;
-                }
+                frame_stats.grid_quads      = view.count;
+                frame_stats.grid_draw_calls = 1;
+                frame_stats.grid_instanced  = true;
+            } else {
+                draw_dice_quads(view, offset);
             }
+
+            EndMode2D();
         }
 
         murl_render(&mu_context);
 
+        if(frame_stats.visible) draw_frame_stats();
+
         EndDrawing();
 
-        if(wiggle_timer < MAX_WIGGLE_TIME) wiggle_timer += GetFrameTime() * 1000;
+        // A frame that ended in a wait took as long as nothing happened for
+        bool  waited   = redraw.waiting;
+        float frame_ms = waited ? 0.0f : GetFrameTime() * 1000;
+
+        if(wiggle_timer < MAX_WIGGLE_TIME) wiggle_timer += frame_ms;
+
+        if(!waited) update_frame_stats(frame_ms);
+
+        update_redraw_mode(waited);
     }
 
     return 0;
@@ -0,0 +1,659 @@
+#ifndef DIST_H
+#define DIST_H
+
+// Exact probability distributions of dice sums.
+//
+// A distribution is its probability mass function over a run of consecutive sums.
+// Adding independent rolls convolves their distributions, so NdS is the single die
+// distribution convolved with itself N times. Repeated squaring gets there in
+// O(log N) convolutions, and every convolution past a few dozen outcomes goes
+// through an FFT, which makes something like 10000d20 take milliseconds.
+//
+// Keeping the highest or lowest few dice is an order statistic. It is worked out face by
+// face from the end that gets dropped first, see dist_keep.
+//
+// Success counts (dice at or above a threshold) follow a binomial distribution instead,
+// which is evaluated term by term in log space from a table of log factorials that is
+// kept around between calls, so N up to 10^6 neither overflows nor starts over.
+//
+// The FFT works in doubles, so every probability carries an absolute error of
+// around 1e-16. Tails smaller than that come out as noise, which is clamped to 0.
+//
+// #define DIST_IMPLEMENTATION in exactly one file before including this.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef struct DiceDist {
+    int64_t min;      // smallest possible sum, pmf[0] is its probability
+    size_t  count;    // amount of consecutive sums
+    double *pmf;
+    double *cdf;      // cdf[i]      = P(sum <= min + i)
+    double *at_least; // at_least[i] = P(sum >= min + i), kept apart to stay exact in the upper tail
+} DiceDist;
+
+// All of these overwrite dist, free it first if it holds anything
+void   dist_constant(DiceDist *dist, int64_t value);
+void   dist_dice_sum(DiceDist *dist, uint64_t amount, uint32_t sides);
+void   dist_repeat(DiceDist *dist, const DiceDist *die, uint64_t amount); // sum of amount independent rolls of die
+void   dist_convolve(DiceDist *dist, const DiceDist *a, const DiceDist *b); // distribution of a + b
+void   dist_successes(DiceDist *dist, uint64_t amount, double p); // successes out of amount dice that each succeed with p
+void   dist_bernoulli(DiceDist *dist, double p);                    // 1 with p, 0 otherwise
+void   dist_from_counts(DiceDist *dist, int64_t min, const uint64_t *counts, size_t count); // how often each sum from min on came up
+void   dist_copy(DiceDist *dist, const DiceDist *from);
+void   dist_negate(DiceDist *dist, const DiceDist *a);
+bool   dist_product(DiceDist *dist, const DiceDist *a, const DiceDist *b, size_t max_count); // false if a * b spans more than max_count sums
+// Sum of the highest (or lowest) keep of amount dice, where a kept die showing face f
+// adds values[f] and shows it with chances[f], or 1 / sides when chances is NULL.
+// Index 0 of both is unused. False if it spans more than max_count sums or would
+// take too long.
+bool   dist_keep(DiceDist *dist, uint64_t amount, uint32_t sides, uint64_t keep, bool highest,
+                 const uint32_t *values, const double *chances, size_t max_count);
+
+double dist_pmf(const DiceDist *dist, int64_t sum);
+double dist_cdf(const DiceDist *dist, int64_t sum);
+double dist_at_least(const DiceDist *dist, int64_t sum);
+double dist_mean(const DiceDist *dist);
+int64_t dist_max(const DiceDist *dist);
+void   dist_free(DiceDist *dist);
+
+// Normal approximations of P(sum >= value) and P(successes >= value) for pools far
+// too big to compute exactly
+double dist_normal_at_least(uint64_t amount, uint32_t sides, double value);
+double dist_successes_normal_at_least(uint64_t amount, double p, double value);
+
+#endif // DIST_H
+
+#ifdef DIST_IMPLEMENTATION
+#undef DIST_IMPLEMENTATION
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Below this many outcomes on either side a plain convolution is both faster and exact
+#define DIST_DIRECT_MAX 48
+
+typedef struct DistComplex {
+    double re, im;
+} DistComplex;
+
+// Transforms up to this size run their stages one after the other, bigger ones split
+// into halves depth first so that every stage below this size stays in cache
+#define DIST_FFT_BLOCK 4096
+
+// In place radix-2 FFTs. roots[half + k] = exp(-2 pi i k / (2 * half)) for every power
+// of two half, so each stage reads its roots in order. The forward transform leaves
+// its output in bit reversed order and the inverse one takes it that way, which a
+// pointwise product does not care about, so neither has to reorder anything. Plain
+// structs instead of complex.h since its multiply has to handle infinities and is
+// far slower.
+static void dist_fft_stage_forward(DistComplex *a, size_t n, size_t half, const DistComplex *roots) {
+    const DistComplex *w = &roots[half];
+    for(size_t start = 0; start < n; start += 2 * half) {
+        for(size_t k = 0; k < half; k++) {
+            DistComplex u = a[start + k];
+            DistComplex v = a[start + k + half];
+            DistComplex d = { u.re - v.re, u.im - v.im };
+
+            a[start + k]        = (DistComplex){ u.re + v.re, u.im + v.im };
+            a[start + k + half] = (DistComplex){ d.re * w[k].re - d.im * w[k].im, d.re * w[k].im + d.im * w[k].re };
+        }
+    }
+}
+
+static void dist_fft_stage_inverse(DistComplex *a, size_t n, size_t half, const DistComplex *roots) {
+    const DistComplex *w = &roots[half];
+    for(size_t start = 0; start < n; start += 2 * half) {
+        for(size_t k = 0; k < half; k++) {
+            DistComplex u = a[start + k];
+            DistComplex x = a[start + k + half];
+            DistComplex v = { x.re * w[k].re + x.im * w[k].im, x.im * w[k].re - x.re * w[k].im }; // x * conj(w)
+
+            a[start + k]        = (DistComplex){ u.re + v.re, u.im + v.im };
+            a[start + k + half] = (DistComplex){ u.re - v.re, u.im - v.im };
+        }
+    }
+}
+
+static void dist_fft_forward(DistComplex *a, size_t n, const DistComplex *roots) {
+    if(n > DIST_FFT_BLOCK) {
+        dist_fft_stage_forward(a, n, n / 2, roots);
+        dist_fft_forward(a,         n / 2, roots);
+        dist_fft_forward(a + n / 2, n / 2, roots);
+        return;
+    }
+
+    for(size_t half = n / 2; half >= 1; half >>= 1)
+        dist_fft_stage_forward(a, n, half, roots);
+}
+
+static void dist_fft_inverse(DistComplex *a, size_t n, const DistComplex *roots) {
+    if(n > DIST_FFT_BLOCK) {
+        dist_fft_inverse(a,         n / 2, roots);
+        dist_fft_inverse(a + n / 2, n / 2, roots);
+        dist_fft_stage_inverse(a, n, n / 2, roots);
+        return;
+    }
+
+    for(size_t half = 1; half < n; half <<= 1)
+        dist_fft_stage_inverse(a, n, half, roots);
+}
+
+// The roots of a stage do not depend on the transform size, so one table serves every
+// transform up to its size and only ever has to grow. Not thread safe.
+static DistComplex *dist_roots      = NULL;
+static size_t       dist_roots_size = 0;
+
+static const DistComplex *dist_fft_roots(size_t n) {
+    if(n <= dist_roots_size) return dist_roots;
+
+    free(dist_roots);
+    dist_roots      = malloc(n * sizeof(*dist_roots));
+    dist_roots_size = n;
+
+    for(size_t k = 0; k < n / 2; k++) {
+        double angle = -2.0 * M_PI * (double)k / (double)n;
+        dist_roots[n / 2 + k] = (DistComplex){ cos(angle), sin(angle) };
+    }
+
+    // Smaller transforms use every other root of the next bigger one
+    for(size_t half = n / 4; half >= 1; half >>= 1)
+        for(size_t k = 0; k < half; k++) dist_roots[half + k] = dist_roots[2 * half + 2 * k];
+
+    return dist_roots;
+}
+
+// out has na + nb - 1 entries
+static void dist_convolve_raw(const double *a, size_t na, const double *b, size_t nb, double *out) {
+    size_t nout = na + nb - 1;
+
+    if(na <= DIST_DIRECT_MAX || nb <= DIST_DIRECT_MAX) {
+        memset(out, 0, nout * sizeof(*out));
+        for(size_t i = 0; i < na; i++)
+            for(size_t j = 0; j < nb; j++) out[i + j] += a[i] * b[j];
+        return;
+    }
+
+    size_t n = 1;
+    while(n < nout) n <<= 1;
+
+    const DistComplex *roots = dist_fft_roots(n);
+
+    // Squaring, which is most of the work, only needs one forward transform
+    bool squaring = a == b && na == nb;
+
+    DistComplex *fa = calloc(n, sizeof(*fa));
+    for(size_t i = 0; i < na; i++) fa[i].re = a[i];
+    dist_fft_forward(fa, n, roots);
+
+    DistComplex *fb = fa;
+    if(!squaring) {
+        fb = calloc(n, sizeof(*fb));
+        for(size_t i = 0; i < nb; i++) fb[i].re = b[i];
+        dist_fft_forward(fb, n, roots);
+    }
+
+    for(size_t k = 0; k < n; k++) {
+        DistComplex x = fa[k], y = fb[k];
+        fa[k] = (DistComplex){ x.re * y.re - x.im * y.im, x.re * y.im + x.im * y.re };
+    }
+
+    dist_fft_inverse(fa, n, roots);
+
+    for(size_t i = 0; i < nout; i++) {
+        double value = fa[i].re / (double)n;
+        out[i] = value > 0.0 ? value : 0.0;
+    }
+
+    if(!squaring) free(fb);
+    free(fa);
+}
+
+static void dist_finish(DiceDist *dist) {
+    dist->cdf      = malloc(dist->count * sizeof(double));
+    dist->at_least = malloc(dist->count * sizeof(double));
+
+    double total = 0.0;
+    for(size_t i = 0; i < dist->count; i++) {
+        total += dist->pmf[i];
+        dist->cdf[i] = total < 1.0 ? total : 1.0;
+    }
+
+    total = 0.0;
+    for(size_t i = dist->count; i-- > 0; ) {
+        total += dist->pmf[i];
+        dist->at_least[i] = total < 1.0 ? total : 1.0;
+    }
+}
+
+void dist_constant(DiceDist *dist, int64_t value) {
+    dist->min    = value;
+    dist->count  = 1;
+    dist->pmf    = malloc(sizeof(double));
+    dist->pmf[0] = 1.0;
+    dist_finish(dist);
+}
+
+void dist_from_counts(DiceDist *dist, int64_t min, const uint64_t *counts, size_t count) {
+    uint64_t total = 0;
+    for(size_t i = 0; i < count; i++) total += counts[i];
+
+    dist->min   = min;
+    dist->count = count;
+    dist->pmf   = malloc(count * sizeof(double));
+    for(size_t i = 0; i < count; i++) dist->pmf[i] = total > 0 ? (double)counts[i] / (double)total : 0.0;
+    dist_finish(dist);
+}
+
+void dist_convolve(DiceDist *dist, const DiceDist *a, const DiceDist *b) {
+    dist->min   = a->min + b->min;
+    dist->count = a->count + b->count - 1;
+    dist->pmf   = malloc(dist->count * sizeof(double));
+    dist_convolve_raw(a->pmf, a->count, b->pmf, b->count, dist->pmf);
+    dist_finish(dist);
+}
+
+// die convolved with itself amount times, amount > 0. Square and multiply from the
+// highest bit of amount down, so every multiply is by a single die, which for real
+// dice is a cheap direct convolution, and the FFTs only ever go into squaring.
+static double *dist_power_raw(const double *die, size_t sides, uint64_t amount, size_t *count) {
+    int top = 63;
+    while(!((amount >> top) & 1)) top--;
+
+    size_t  result_count = sides;
+    double *result       = malloc(sides * sizeof(double));
+    memcpy(result, die, sides * sizeof(double));
+
+    for(int bit = top - 1; bit >= 0; bit--) {
+        double *next = malloc((2 * result_count - 1) * sizeof(double));
+        dist_convolve_raw(result, result_count, result, result_count, next);
+        free(result);
+        result        = next;
+        result_count  = 2 * result_count - 1;
+
+        if((amount >> bit) & 1) {
+            next = malloc((result_count + sides - 1) * sizeof(double));
+            dist_convolve_raw(result, result_count, die, sides, next);
+            free(result);
+            result        = next;
+            result_count += sides - 1;
+        }
+    }
+
+    *count = result_count;
+    return result;
+}
+
+void dist_dice_sum(DiceDist *dist, uint64_t amount, uint32_t sides) {
+    if(amount == 0 || sides == 0) {
+        dist_constant(dist, 0);
+        return;
+    }
+
+    // Faces 1..S are an offset of 1 on top of a uniform 0..S-1, so only the
+    // uniform part gets convolved and the offset is added once at the end
+    double *die = malloc(sides * sizeof(double));
+    for(size_t i = 0; i < sides; i++) die[i] = 1.0 / (double)sides;
+
+    dist->min = (int64_t)amount;
+    dist->pmf = dist_power_raw(die, sides, amount, &dist->count);
+    dist_finish(dist);
+
+    free(die);
+}
+
+void dist_repeat(DiceDist *dist, const DiceDist *die, uint64_t amount) {
+    if(amount == 0) {
+        dist_constant(dist, 0);
+        return;
+    }
+
+    dist->min = die->min * (int64_t)amount;
+    dist->pmf = dist_power_raw(die->pmf, die->count, amount, &dist->count);
+    dist_finish(dist);
+}
+
+// log(n!) for n up to the size of the table, which grows as needed. Not thread safe.
+static double *dist_log_factorials      = NULL;
+static size_t  dist_log_factorial_count = 0;
+
+static const double *dist_log_factorial_table(uint64_t max) {
+    if(max < dist_log_factorial_count) return dist_log_factorials;
+
+    size_t count = dist_log_factorial_count == 0 ? 1024 : dist_log_factorial_count;
+    while(count <= max) count *= 2;
+
+    dist_log_factorials = realloc(dist_log_factorials, count * sizeof(double));
+    if(dist_log_factorial_count == 0) dist_log_factorials[dist_log_factorial_count++] = 0.0;
+
+    // Every entry is the one before plus a log, so growing never redoes old entries
+    for(size_t n = dist_log_factorial_count; n < count; n++)
+        dist_log_factorials[n] = dist_log_factorials[n - 1] + log((double)n);
+
+    dist_log_factorial_count = count;
+    return dist_log_factorials;
+}
+
+void dist_successes(DiceDist *dist, uint64_t amount, double p) {
+    dist->min   = 0;
+    dist->count = amount + 1;
+    dist->pmf   = malloc(dist->count * sizeof(double));
+
+    if(p <= 0.0 || p >= 1.0) {
+        memset(dist->pmf, 0, dist->count * sizeof(double));
+        dist->pmf[p <= 0.0 ? 0 : amount] = 1.0;
+        dist_finish(dist);
+        return;
+    }
+
+    const double *log_factorial = dist_log_factorial_table(amount);
+    double log_p = log(p);
+    double log_q = log1p(-p);
+
+    for(uint64_t k = 0; k <= amount; k++) {
+        double log_pmf = log_factorial[amount] - log_factorial[k] - log_factorial[amount - k]
+                       + (double)k * log_p + (double)(amount - k) * log_q;
+        dist->pmf[k] = exp(log_pmf);
+    }
+
+    dist_finish(dist);
+}
+
+void dist_bernoulli(DiceDist *dist, double p) {
+    dist->min    = 0;
+    dist->count  = 2;
+    dist->pmf    = malloc(2 * sizeof(double));
+    dist->pmf[0] = 1.0 - p;
+    dist->pmf[1] = p;
+    dist_finish(dist);
+}
+
+void dist_copy(DiceDist *dist, const DiceDist *from) {
+    dist->min   = from->min;
+    dist->count = from->count;
+    dist->pmf   = malloc(from->count * sizeof(double));
+    memcpy(dist->pmf, from->pmf, from->count * sizeof(double));
+    dist_finish(dist);
+}
+
+void dist_negate(DiceDist *dist, const DiceDist *a) {
+    dist->min   = -dist_max(a);
+    dist->count = a->count;
+    dist->pmf   = malloc(a->count * sizeof(double));
+    for(size_t i = 0; i < a->count; i++) dist->pmf[i] = a->pmf[a->count - 1 - i];
+    dist_finish(dist);
+}
+
+// Every pair of outcomes, which is fine since one side is nearly always a constant
+bool dist_product(DiceDist *dist, const DiceDist *a, const DiceDist *b, size_t max_count) {
+    // Big constant factors can take the corners past int64, which is no range to trust
+    int64_t a_ends[2] = { a->min, dist_max(a) };
+    int64_t b_ends[2] = { b->min, dist_max(b) };
+    int64_t corners[4];
+    for(int i = 0; i < 4; i++)
+        if(__builtin_mul_overflow(a_ends[i / 2], b_ends[i % 2], &corners[i])) return false;
+
+    int64_t low = corners[0], high = corners[0];
+    for(int i = 1; i < 4; i++) {
+        if(corners[i] < low)  low  = corners[i];
+        if(corners[i] > high) high = corners[i];
+    }
+
+    int64_t span;
+    if(__builtin_sub_overflow(high, low, &span) || (uint64_t)span >= max_count) return false;
+
+    dist->min   = low;
+    dist->count = (size_t)span + 1;
+    dist->pmf   = calloc(dist->count, sizeof(double));
+
+    for(size_t i = 0; i < a->count; i++) {
+        if(a->pmf[i] == 0.0) continue;
+        for(size_t j = 0; j < b->count; j++)
+            dist->pmf[(a->min + (int64_t)i) * (b->min + (int64_t)j) - low] += a->pmf[i] * b->pmf[j];
+    }
+
+    dist_finish(dist);
+    return true;
+}
+
+// Upper bound on the multiply-adds dist_keep may spend
+#define DIST_KEEP_MAX_WORK (1 << 28)
+
+// terms[c] = P(c out of r dice land on a face each one lands on with p). Starts at
+// the mode and walks outwards with the ratio of neighbouring terms, so only one of
+// them needs the log factorials.
+static void dist_binomial_terms(uint64_t r, double p, double *terms) {
+    if(p <= 0.0 || p >= 1.0) {
+        memset(terms, 0, (r + 1) * sizeof(*terms));
+        terms[p <= 0.0 ? 0 : r] = 1.0;
+        return;
+    }
+
+    const double *log_factorial = dist_log_factorial_table(r);
+    uint64_t mode = (uint64_t)((double)(r + 1) * p);
+    if(mode > r) mode = r;
+
+    double odds = p / (1.0 - p);
+    terms[mode] = exp(log_factorial[r] - log_factorial[mode] - log_factorial[r - mode]
+                      + (double)mode * log(p) + (double)(r - mode) * log1p(-p));
+
+    // Cut off at the bottom of the double range instead of crawling through denormals
+    for(uint64_t c = mode; c < r; c++) {
+        double next = terms[c] * (double)(r - c) / (double)(c + 1) * odds;
+        terms[c + 1] = next > 1e-300 ? next : 0.0;
+    }
+    for(uint64_t c = mode; c > 0; c--) {
+        double next = terms[c] * (double)c / (double)(r - c + 1) / odds;
+        terms[c - 1] = next > 1e-300 ? next : 0.0;
+    }
+}
+
+static DistComplex dist_complex_mul(DistComplex a, DistComplex b) {
+    return (DistComplex){ a.re * b.re - a.im * b.im, a.re * b.im + a.im * b.re };
+}
+
+// Adds x^(keep * base) * sum over r of weights[r] * die(x)^r to spectrum, where die(x)
+// is one die over faces, which show up with their share of chance, shifted down by
+// base. Exponents wrap around n, which is fine as long as the final sums span less
+// than n.
+static void dist_keep_add(DistComplex *spectrum, size_t n, const DistComplex *roots, const double *weights, uint64_t bottom, uint64_t top,
+                          uint64_t keep, uint32_t base, const uint32_t *values, const double *chance, const uint32_t *faces, size_t face_count) {
+    DistComplex *die   = calloc(n, sizeof(*die));
+    DistComplex *shift = calloc(n, sizeof(*shift));
+
+    double total = 0.0;
+    for(size_t i = 0; i < face_count; i++) total += chance[faces[i]];
+
+    for(size_t i = 0; i < face_count && total > 0.0; i++)
+        die[((uint64_t)values[faces[i]] + n - base % n) % n].re += chance[faces[i]] / total;
+    shift[(keep % n) * (base % n) % n].re = 1.0;
+
+    dist_fft_forward(die, n, roots);
+    dist_fft_forward(shift, n, roots);
+
+    for(size_t k = 0; k < n; k++) {
+        // Horner over the weights that are not 0. die(x) never goes above 1 on the unit
+        // circle, and running it through the zeros below bottom would decay the sum into
+        // denormals, which are many times slower, so die^bottom is squared up instead.
+        DistComplex sum = { weights[top], 0.0 };
+        for(uint64_t r = top; r-- > bottom; ) {
+            sum     = dist_complex_mul(sum, die[k]);
+            sum.re += weights[r];
+        }
+
+        DistComplex power = die[k];
+        for(uint64_t e = bottom; e > 0; e >>= 1) {
+            if(e & 1) sum = dist_complex_mul(sum, power);
+            if(e > 1) power = dist_complex_mul(power, power);
+        }
+
+        sum = dist_complex_mul(sum, shift[k]);
+        spectrum[k].re += sum.re;
+        spectrum[k].im += sum.im;
+    }
+
+    free(shift);
+    free(die);
+}
+
+// Goes through the faces in the order dice get dropped, tracking how many have been
+// dropped so far. Every face takes a binomial share of the dice still left, and as
+// soon as enough are dropped the rest are all kept: what they add is the generating
+// function of one die over the faces not seen yet, raised to how many are left. Those
+// are summed up for every face in the frequency domain, so there is a single inverse
+// FFT at the end and nothing ever enumerates the sides^amount rolls.
+bool dist_keep(DiceDist *dist, uint64_t amount, uint32_t sides, uint64_t keep, bool highest,
+               const uint32_t *values, const double *chances, size_t max_count) {
+    if(keep > amount) keep = amount;
+    if(keep == 0 || sides == 0) {
+        dist_constant(dist, 0);
+        return true;
+    }
+
+    uint32_t low = UINT32_MAX, high = 0;
+    for(uint32_t face = 1; face <= sides; face++) {
+        if(values[face] < low)  low  = values[face];
+        if(values[face] > high) high = values[face];
+    }
+
+    if(high > low && keep >= max_count / (high - low)) return false;
+    uint64_t span = keep * (high - low);
+    uint64_t drop = amount - keep;
+
+    size_t n = 2;
+    while(n <= span) n <<= 1;
+
+    double work = (double)sides * ((double)drop * (double)amount + (double)keep * (double)n);
+    if(work > DIST_KEEP_MAX_WORK) return false;
+
+    uint32_t *faces = malloc(sides * sizeof(*faces));
+    for(uint32_t i = 0; i < sides; i++) faces[i] = highest ? i + 1 : sides - i;
+
+    double *chance = malloc((sides + 1) * sizeof(*chance));
+    for(uint32_t face = 1; face <= sides; face++) chance[face] = chances != NULL ? chances[face] : 1.0 / (double)sides;
+
+    const DistComplex *roots    = dist_fft_roots(n);
+    DistComplex       *spectrum = calloc(n, sizeof(*spectrum));
+    double            *kept     = calloc(keep + 1, sizeof(*kept)); // kept[r]: dropping is done and r dice are still left
+
+    if(drop == 0) {
+        kept[keep] = 1.0;
+        dist_keep_add(spectrum, n, roots, kept, keep, keep, keep, 0, values, chance, faces, sides);
+    } else {
+        double *dropped = calloc(drop, sizeof(*dropped)); // dropped[j]: j dice dropped so far
+        double *next    = malloc(drop * sizeof(*next));
+        double *terms   = malloc((amount + 1) * sizeof(*terms));
+        dropped[0] = 1.0;
+
+        for(uint32_t t = 0; t < sides; t++) {
+            memset(next, 0, drop * sizeof(*next));
+            memset(kept, 0, (keep + 1) * sizeof(*kept));
+
+            // A die that is left lands on face t with its share of the chance of the
+            // faces not gone through yet
+            double remaining = 0.0;
+            for(uint32_t u = t; u < sides; u++) remaining += chance[faces[u]];
+            double share = t + 1 == sides || remaining <= 0.0 ? 1.0 : chance[faces[t]] / remaining;
+
+            for(uint64_t j = 0; j < drop; j++) {
+                if(dropped[j] == 0.0) continue;
+
+                uint64_t left = amount - j;
+                dist_binomial_terms(left, share, terms);
+
+                for(uint64_t c = 0; c <= left; c++) {
+                    if(j + c < drop) next[j + c]    += dropped[j] * terms[c];
+                    else             kept[left - c] += dropped[j] * terms[c];
+                }
+            }
+
+            // The j + c - drop dice past the quota on this face are kept at its value,
+            // which together with the r left over always makes keep
+            // Ends far below anything a double sum can see get dropped as well, they only
+            // ever make denormals
+            uint64_t top = keep, bottom = 0;
+            while(top > 0 && kept[top] < 1e-200) top--;
+            while(bottom < top && kept[bottom] < 1e-200) bottom++;
+            dist_keep_add(spectrum, n, roots, kept, bottom, top, keep, values[faces[t]], values, chance, faces + t + 1, sides - t - 1);
+
+            double *swap = dropped;
+            dropped = next;
+            next    = swap;
+        }
+
+        free(terms);
+        free(next);
+        free(dropped);
+    }
+
+    dist_fft_inverse(spectrum, n, roots);
+
+    dist->min   = (int64_t)(keep * low);
+    dist->count = span + 1;
+    dist->pmf   = malloc(dist->count * sizeof(double));
+    for(size_t i = 0; i < dist->count; i++) {
+        double value = spectrum[(keep * low + i) % n].re / (double)n;
+        dist->pmf[i] = value > 0.0 ? value : 0.0;
+    }
+    dist_finish(dist);
+
+    free(kept);
+    free(spectrum);
+    free(chance);
+    free(faces);
+    return true;
+}
+
+double dist_pmf(const DiceDist *dist, int64_t sum) {
+    if(sum < dist->min || sum >= dist->min + (int64_t)dist->count) return 0.0;
+    return dist->pmf[sum - dist->min];
+}
+
+double dist_cdf(const DiceDist *dist, int64_t sum) {
+    if(sum < dist->min) return 0.0;
+    if(sum >= dist->min + (int64_t)dist->count) return 1.0;
+    return dist->cdf[sum - dist->min];
+}
+
+double dist_at_least(const DiceDist *dist, int64_t sum) {
+    if(sum <= dist->min) return 1.0;
+    if(sum >= dist->min + (int64_t)dist->count) return 0.0;
+    return dist->at_least[sum - dist->min];
+}
+
+double dist_mean(const DiceDist *dist) {
+    double mean = 0.0;
+    for(size_t i = 0; i < dist->count; i++) mean += (double)(dist->min + (int64_t)i) * dist->pmf[i];
+    return mean;
+}
+
+int64_t dist_max(const DiceDist *dist) {
+    return dist->min + (int64_t)dist->count - 1;
+}
+
+void dist_free(DiceDist *dist) {
+    free(dist->pmf);
+    free(dist->cdf);
+    free(dist->at_least);
+    *dist = (DiceDist){0};
+}
+
+static double dist_normal_tail(double mean, double variance, double value) {
+    if(variance <= 0.0) return value <= mean ? 1.0 : 0.0;
+
+    // Continuity correction, the outcomes are whole numbers
+    double z = (value - 0.5 - mean) / sqrt(variance);
+    return 0.5 * erfc(z / M_SQRT2);
+}
+
+double dist_normal_at_least(uint64_t amount, uint32_t sides, double value) {
+    return dist_normal_tail((double)amount * (sides + 1.0) / 2.0, (double)amount * ((double)sides * sides - 1.0) / 12.0, value);
+}
+
+double dist_successes_normal_at_least(uint64_t amount, double p, double value) {
+    return dist_normal_tail((double)amount * p, (double)amount * p * (1.0 - p), value);
+}
+
+#endif // DIST_IMPLEMENTATION
@@ -0,0 +1,1126 @@
+#ifndef EXPR_H
+#define EXPR_H
+
+// Dice expressions like `12d6 + 4d8 + 5`, `4d6kh3`, `8d10 >= 7` or `3d6!`.
+//
+// Text is compiled once into a small stack bytecode and from then on only the VM runs,
+// so replaying a macro never touches the text again. Grammar, loosest binding first:
+//
+//   expr    = expr cmp expr | expr ('+' | '-') expr | expr '*' expr | '-' expr
+//           | NUMBER | dice | '(' expr ')'
+//   dice    = [NUMBER] 'd' NUMBER modifier*
+//   modifier= ('kh' | 'k' | 'kl' | 'dh' | 'dl') [NUMBER]   keep/drop highest/lowest, 1 by default
+//           | ('r' | 'ro') [cmp] NUMBER                   reroll faces that pass, once for 'ro'
+//           | '!'                                         roll again and add on the highest face
+//   cmp     = '>=' | '>' | '<=' | '<' | '=' | '==' | '!='
+//
+// A comparison between a bare dice term and a constant counts the dice that pass
+// (`8d10 >= 7` is the amount of dice showing 7 or more), any other comparison is 1
+// when it holds and 0 when it does not. Rerolls without a comparison reroll that face
+// (`d10r1`). Exploding dice are summed, so they cannot be kept or counted, and a
+// comparison with them compares the total.
+//
+// Dice terms are rolled as a face histogram, in bulk for small amounts and straight
+// from the multinomial distribution for big ones, and keep/drop picks from the
+// histogram, so nothing ever gets sorted. Rerolls and explosions roll the dice that
+// need it as another histogram, round after round, instead of going die by die.
+//
+// The same bytecode also runs over distributions instead of numbers, which turns the
+// expression into convolutions, negations and products of exact PMFs. Dice terms
+// come out of an ExprDistCache, so the same NdS is only ever computed once no
+// matter how many expressions use it. Exploding dice have no end, so their
+// distributions stop at the depth that leaves out less than the cache's tolerance.
+//
+// #define EXPR_IMPLEMENTATION in exactly one file before including this, rng.h,
+// kernels.h and dist.h have to be included first.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define EXPR_MAX_STACK 64
+#define EXPR_MAX_SIDES 255
+
+typedef enum ExprOpCode {
+    EXPR_OP_CONST, // pushes constants[arg]
+    EXPR_OP_DICE,  // pushes a roll of dice[arg]
+    EXPR_OP_ADD,
+    EXPR_OP_SUB,
+    EXPR_OP_MUL,
+    EXPR_OP_NEG,
+    EXPR_OP_CMP,   // pops b and a, pushes a <arg> b as 1 or 0
+} ExprOpCode;
+
+typedef enum ExprCmp {
+    EXPR_CMP_NONE,
+    EXPR_CMP_GE,
+    EXPR_CMP_GT,
+    EXPR_CMP_LE,
+    EXPR_CMP_LT,
+    EXPR_CMP_EQ,
+    EXPR_CMP_NE,
+} ExprCmp;
+
+typedef enum ExprKeep {
+    EXPR_KEEP_ALL,
+    EXPR_KEEP_HIGHEST,
+    EXPR_KEEP_LOWEST,
+} ExprKeep;
+
+typedef struct ExprOp {
+    uint8_t  code;
+    uint32_t arg;
+} ExprOp;
+
+typedef struct ExprDice {
+    uint32_t amount;
+    uint32_t sides;
+    ExprKeep keep;          // drops are stored as keeping the rest
+    uint32_t keep_count;
+    ExprCmp  count_cmp;     // when set, the term is how many kept dice pass instead of their sum
+    int64_t  count_target;
+    ExprCmp  reroll_cmp;    // faces that pass get rolled again
+    int64_t  reroll_target;
+    bool     reroll_once;   // otherwise until the face does not pass
+    bool     explode;       // the highest face rolls another die that gets added
+} ExprDice;
+
+typedef struct Expr {
+    ExprOp   *ops;
+    size_t    op_count;
+    size_t    op_capacity;
+
+    ExprDice *dice;
+    size_t    dice_count;
+    size_t    dice_capacity;
+
+    int64_t  *constants;
+    size_t    constant_count;
+    size_t    constant_capacity;
+} Expr;
+
+typedef struct ExprError {
+    size_t      position; // byte offset into the text
+    const char *message;
+} ExprError;
+
+// On failure expr is left empty and error, when not NULL, says what went wrong
+bool    expr_compile(Expr *expr, const char *text, ExprError *error);
+int64_t expr_eval(const Expr *expr, Rng *rng);
+void    expr_free(Expr *expr);
+
+// Rolls expr n times into out. Each op runs over EXPR_BATCH rolls at once and small
+// dice terms roll the dice for all of them with one fill, so this draws from rng in
+// another order than calling expr_eval n times would.
+#define EXPR_BATCH 64
+void    expr_eval_batch(const Expr *expr, Rng *rng, int64_t *out, size_t n);
+void    expr_copy(Expr *expr, const Expr *from);
+
+// Code that did not come out of expr_compile, like code read back from a file, has to
+// pass this before it is run
+bool    expr_check(const Expr *expr);
+
+// True when the whole expression is a single dice term that is summed as is
+bool    expr_plain_dice(const Expr *expr, ExprDice *dice);
+
+// Distributions spanning more sums than this are refused instead of eating all memory
+#define EXPR_DIST_MAX_COUNT (1 << 21)
+
+// Probability an exploding term may leave out when the cache does not ask for another one
+#define EXPR_DIST_TOLERANCE 1e-12
+
+// Rounds of explosions a roll goes through at most, d2! gets there once in 2^100 rolls
+#define EXPR_MAX_EXPLOSIONS 100
+
+typedef struct ExprDistEntry {
+    ExprDice  key;
+    DiceDist *dist; // NULL for an empty slot, on the heap so rehashing never moves it
+} ExprDistEntry;
+
+// Open addressing table of dice term distributions
+typedef struct ExprDistCache {
+    ExprDistEntry *entries;
+    size_t         count;
+    size_t         capacity; // power of two
+    size_t         hits;
+    size_t         misses;
+    double         tolerance; // per exploding term, EXPR_DIST_TOLERANCE when 0
+} ExprDistCache;
+
+// On failure error, when not NULL, says why
+bool    expr_distribution(const Expr *expr, ExprDistCache *cache, DiceDist *dist, const char **error);
+void    expr_dist_cache_free(ExprDistCache *cache);
+
+#endif // EXPR_H
+
+#ifdef EXPR_IMPLEMENTATION
+#undef EXPR_IMPLEMENTATION
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define EXPR_APPEND(items, count, capacity, item)                                   \
+    do {                                                                            \
+        if((count) == (capacity)) {                                                 \
+            (capacity) = (capacity) == 0 ? 16 : (capacity) * 2;                     \
+            (items)    = realloc((items), (capacity) * sizeof(*(items)));           \
+        }                                                                           \
+        (items)[(count)++] = (item);                                                \
+    } while(0)
+
+typedef enum ExprTokenKind {
+    EXPR_TOKEN_END,
+    EXPR_TOKEN_NUMBER,
+    EXPR_TOKEN_DICE,
+    EXPR_TOKEN_PLUS,
+    EXPR_TOKEN_MINUS,
+    EXPR_TOKEN_STAR,
+    EXPR_TOKEN_OPEN,
+    EXPR_TOKEN_CLOSE,
+    EXPR_TOKEN_CMP,
+    EXPR_TOKEN_KEEP_HIGHEST,
+    EXPR_TOKEN_KEEP_LOWEST,
+    EXPR_TOKEN_DROP_HIGHEST,
+    EXPR_TOKEN_DROP_LOWEST,
+    EXPR_TOKEN_REROLL,
+    EXPR_TOKEN_REROLL_ONCE,
+    EXPR_TOKEN_EXPLODE,
+    EXPR_TOKEN_INVALID,
+} ExprTokenKind;
+
+typedef struct ExprToken {
+    ExprTokenKind kind;
+    size_t        position;
+    uint32_t      number;
+    ExprCmp       cmp;
+} ExprToken;
+
+typedef struct ExprParser {
+    const char *text;
+    size_t      cursor;
+    ExprToken   token;     // the one not consumed yet
+    Expr       *expr;
+    ExprError   error;
+    bool        failed;
+    size_t      depth;     // stack depth the code emitted so far leaves behind
+    size_t      nesting;   // expr_parse calls that have not returned yet
+} ExprParser;
+
+static void expr_fail(ExprParser *parser, size_t position, const char *message) {
+    if(parser->failed) return;
+    parser->failed         = true;
+    parser->error.position = position;
+    parser->error.message  = message;
+}
+
+static void expr_next_token(ExprParser *parser) {
+    const char *text = parser->text;
+    size_t      at   = parser->cursor;
+
+    while(text[at] == ' ' || text[at] == '\t') at++;
+
+    ExprToken token = { .kind = EXPR_TOKEN_INVALID, .position = at };
+    char c    = text[at];
+    char next = c != '\0' ? text[at + 1] : '\0';
+
+    if(c >= '0' && c <= '9') {
+        uint64_t number = 0;
+        while(text[at] >= '0' && text[at] <= '9') {
+            number = number * 10 + (uint64_t)(text[at++] - '0');
+            if(number > UINT32_MAX) {
+                expr_fail(parser, token.position, "number is too big");
+                number = UINT32_MAX;
+            }
+        }
+        token.kind   = EXPR_TOKEN_NUMBER;
+        token.number = (uint32_t)number;
+    } else {
+        at++;
+        switch(c) {
+            case '\0': token.kind = EXPR_TOKEN_END; at--; break;
+            case '+':  token.kind = EXPR_TOKEN_PLUS;      break;
+            case '-':  token.kind = EXPR_TOKEN_MINUS;     break;
+            case '*':  token.kind = EXPR_TOKEN_STAR;      break;
+            case '(':  token.kind = EXPR_TOKEN_OPEN;      break;
+            case ')':  token.kind = EXPR_TOKEN_CLOSE;     break;
+
+            case 'd': case 'D':
+                if(next == 'h')      { token.kind = EXPR_TOKEN_DROP_HIGHEST; at++; }
+                else if(next == 'l') { token.kind = EXPR_TOKEN_DROP_LOWEST;  at++; }
+                else                   token.kind = EXPR_TOKEN_DICE;
+                break;
+
+            case 'k':
+                if(next == 'l')      { token.kind = EXPR_TOKEN_KEEP_LOWEST;  at++; }
+                else {
+                    if(next == 'h') at++;
+                    token.kind = EXPR_TOKEN_KEEP_HIGHEST;
+                }
+                break;
+
+            case '>':
+                token.kind = EXPR_TOKEN_CMP;
+                token.cmp  = next == '=' ? EXPR_CMP_GE : EXPR_CMP_GT;
+                if(next == '=') at++;
+                break;
+
+            case '<':
+                token.kind = EXPR_TOKEN_CMP;
+                token.cmp  = next == '=' ? EXPR_CMP_LE : EXPR_CMP_LT;
+                if(next == '=') at++;
+                break;
+
+            case '=':
+                token.kind = EXPR_TOKEN_CMP;
+                token.cmp  = EXPR_CMP_EQ;
+                if(next == '=') at++;
+                break;
+
+            case 'r':
+                token.kind = next == 'o' ? EXPR_TOKEN_REROLL_ONCE : EXPR_TOKEN_REROLL;
+                if(next == 'o') at++;
+                break;
+
+            case '!':
+                if(next == '=') {
+                    token.kind = EXPR_TOKEN_CMP;
+                    token.cmp  = EXPR_CMP_NE;
+                    at++;
+                } else {
+                    token.kind = EXPR_TOKEN_EXPLODE;
+                }
+                break;
+        }
+    }
+
+    if(token.kind == EXPR_TOKEN_INVALID) expr_fail(parser, token.position, "unexpected character");
+
+    parser->cursor = at;
+    parser->token  = token;
+}
+
+static void expr_emit(ExprParser *parser, ExprOpCode code, uint32_t arg) {
+    switch(code) {
+        case EXPR_OP_CONST:
+        case EXPR_OP_DICE: parser->depth++; break;
+        case EXPR_OP_NEG:                   break;
+        default:           parser->depth--; break;
+    }
+
+    if(parser->depth > EXPR_MAX_STACK) expr_fail(parser, parser->token.position, "expression is nested too deep");
+
+    Expr *expr = parser->expr;
+    EXPR_APPEND(expr->ops, expr->op_count, expr->op_capacity, ((ExprOp){ .code = (uint8_t)code, .arg = arg }));
+}
+
+static void expr_emit_constant(ExprParser *parser, int64_t value) {
+    Expr *expr = parser->expr;
+    EXPR_APPEND(expr->constants, expr->constant_count, expr->constant_capacity, value);
+    expr_emit(parser, EXPR_OP_CONST, (uint32_t)(expr->constant_count - 1));
+}
+
+static bool expr_cmp_holds(ExprCmp cmp, int64_t a, int64_t b) {
+    switch(cmp) {
+        case EXPR_CMP_GE: return a >= b;
+        case EXPR_CMP_GT: return a >  b;
+        case EXPR_CMP_LE: return a <= b;
+        case EXPR_CMP_LT: return a <  b;
+        case EXPR_CMP_EQ: return a == b;
+        case EXPR_CMP_NE: return a != b;
+        default:          return false;
+    }
+}
+
+static bool expr_rerolls(const ExprDice *dice, uint32_t face) {
+    return expr_cmp_holds(dice->reroll_cmp, face, dice->reroll_target);
+}
+
+// Chance of a single roll ending up on each face once its rerolls are done
+static void expr_face_chances(const ExprDice *dice, double *chances) {
+    uint32_t rerolled = 0;
+    for(uint32_t face = 1; face <= dice->sides; face++) rerolled += expr_rerolls(dice, face);
+
+    double sides = (double)dice->sides;
+    for(uint32_t face = 1; face <= dice->sides; face++) {
+        bool again = expr_rerolls(dice, face);
+        if(rerolled == 0)           chances[face] = 1.0 / sides;
+        else if(dice->reroll_once)  chances[face] = (again ? 0.0 : 1.0 / sides) + (double)rerolled / sides / sides;
+        else                        chances[face] = again ? 0.0 : 1.0 / (double)(dice->sides - rerolled);
+    }
+}
+
+// What is wrong with a dice term that would roll forever or break the sampler, NULL
+// when nothing is
+static const char *expr_dice_problem(const ExprDice *dice) {
+    if(dice->sides < 1 || dice->sides > EXPR_MAX_SIDES) return "dice can have 1 to 255 sides";
+    if((unsigned)dice->keep > EXPR_KEEP_LOWEST || (unsigned)dice->count_cmp > EXPR_CMP_NE || (unsigned)dice->reroll_cmp > EXPR_CMP_NE) return "unknown modifier";
+    // Loaded code can hold anything, so whatever the parser never writes is turned down too
+    if(dice->keep == EXPR_KEEP_ALL && dice->keep_count != 0)                             return "keep count without a keep";
+    if(dice->count_cmp == EXPR_CMP_NONE && dice->count_target != 0)                      return "count target without a comparison";
+    if(dice->reroll_cmp == EXPR_CMP_NONE && (dice->reroll_target != 0 || dice->reroll_once)) return "reroll without a comparison";
+    if(dice->reroll_target < 0 || dice->reroll_target > UINT32_MAX)                      return "reroll face out of range";
+    if(dice->explode && dice->count_cmp != EXPR_CMP_NONE)                                return "exploding dice cannot be counted";
+    if(dice->keep != EXPR_KEEP_ALL && dice->keep_count > dice->amount) return "cannot keep or drop more dice than rolled";
+
+    if(dice->reroll_cmp == EXPR_CMP_NONE && !dice->explode) return NULL;
+
+    double chances[EXPR_MAX_SIDES + 1];
+    expr_face_chances(dice, chances);
+
+    uint32_t rerolled = 0;
+    for(uint32_t face = 1; face <= dice->sides; face++) rerolled += expr_rerolls(dice, face);
+
+    if(!dice->reroll_once && rerolled == dice->sides)    return "every face would be rerolled";
+    if(dice->explode && chances[dice->sides] >= 1.0)     return "every roll would explode";
+    if(dice->explode && dice->keep != EXPR_KEEP_ALL)     return "exploding dice cannot be kept or dropped";
+    return NULL;
+}
+
+static int64_t expr_run(const Expr *expr, size_t start, size_t end, Rng *rng);
+
+// Turns the code from start on into a constant if it does not roll anything
+static bool expr_fold_constant(ExprParser *parser, size_t start, int64_t *value) {
+    Expr *expr = parser->expr;
+    for(size_t i = start; i < expr->op_count; i++)
+        if(expr->ops[i].code == EXPR_OP_DICE) return false;
+
+    *value = expr_run(expr, start, expr->op_count, NULL);
+    return true;
+}
+
+typedef struct ExprNode {
+    int64_t dice; // index of the dice term when the node is nothing but that, -1 otherwise
+} ExprNode;
+
+static ExprNode expr_parse(ExprParser *parser, int min_power);
+
+static uint32_t expr_modifier_count(ExprParser *parser) {
+    if(parser->token.kind != EXPR_TOKEN_NUMBER) return 1;
+    uint32_t count = parser->token.number;
+    expr_next_token(parser);
+    return count;
+}
+
+static ExprNode expr_parse_dice(ExprParser *parser, uint32_t amount) {
+    size_t position = parser->token.position;
+    expr_next_token(parser); // the 'd'
+
+    if(parser->token.kind != EXPR_TOKEN_NUMBER) {
+        expr_fail(parser, parser->token.position, "expected the amount of sides after 'd'");
+        return (ExprNode){ .dice = -1 };
+    }
+
+    ExprDice dice = { .amount = amount, .sides = parser->token.number, .keep = EXPR_KEEP_ALL };
+    if(dice.sides < 1)              expr_fail(parser, parser->token.position, "dice need at least one side");
+    if(dice.sides > EXPR_MAX_SIDES) expr_fail(parser, parser->token.position, "dice can have at most 255 sides");
+    expr_next_token(parser);
+
+    for(bool modifying = true; modifying && !parser->failed; ) {
+        ExprTokenKind kind = parser->token.kind;
+        size_t        at   = parser->token.position;
+
+        switch(kind) {
+            case EXPR_TOKEN_KEEP_HIGHEST:
+            case EXPR_TOKEN_KEEP_LOWEST:
+            case EXPR_TOKEN_DROP_HIGHEST:
+            case EXPR_TOKEN_DROP_LOWEST: {
+                expr_next_token(parser);
+                uint32_t count = expr_modifier_count(parser);
+
+                if(dice.keep != EXPR_KEEP_ALL) { expr_fail(parser, at, "only one keep or drop per dice");  break; }
+                if(count > amount)             { expr_fail(parser, at, "cannot keep or drop more dice than rolled"); break; }
+
+                switch(kind) {
+                    case EXPR_TOKEN_KEEP_HIGHEST: dice.keep = EXPR_KEEP_HIGHEST; dice.keep_count = count;          break;
+                    case EXPR_TOKEN_KEEP_LOWEST:  dice.keep = EXPR_KEEP_LOWEST;  dice.keep_count = count;          break;
+                    case EXPR_TOKEN_DROP_HIGHEST: dice.keep = EXPR_KEEP_LOWEST;  dice.keep_count = amount - count; break;
+                    default:                      dice.keep = EXPR_KEEP_HIGHEST; dice.keep_count = amount - count; break;
+                }
+            } break;
+
+            case EXPR_TOKEN_REROLL:
+            case EXPR_TOKEN_REROLL_ONCE: {
+                expr_next_token(parser);
+                ExprCmp cmp = EXPR_CMP_EQ;
+                if(parser->token.kind == EXPR_TOKEN_CMP) {
+                    cmp = parser->token.cmp;
+                    expr_next_token(parser);
+                }
+
+                if(parser->token.kind != EXPR_TOKEN_NUMBER) { expr_fail(parser, parser->token.position, "expected the face to reroll"); break; }
+                if(dice.reroll_cmp != EXPR_CMP_NONE)        { expr_fail(parser, at, "only one reroll per dice"); break; }
+
+                dice.reroll_cmp    = cmp;
+                dice.reroll_target = parser->token.number;
+                dice.reroll_once   = kind == EXPR_TOKEN_REROLL_ONCE;
+                expr_next_token(parser);
+            } break;
+
+            case EXPR_TOKEN_EXPLODE:
+                if(dice.explode) expr_fail(parser, at, "dice only explode once");
+                dice.explode = true;
+                expr_next_token(parser);
+                break;
+
+            default: modifying = false; break;
+        }
+    }
+
+    const char *problem = parser->failed ? NULL : expr_dice_problem(&dice);
+    if(problem != NULL) expr_fail(parser, position, problem);
+
+    Expr *expr = parser->expr;
+    EXPR_APPEND(expr->dice, expr->dice_count, expr->dice_capacity, dice);
+    expr_emit(parser, EXPR_OP_DICE, (uint32_t)(expr->dice_count - 1));
+
+    return (ExprNode){ .dice = (int64_t)expr->dice_count - 1 };
+}
+
+static ExprNode expr_parse_prefix(ExprParser *parser) {
+    ExprToken token = parser->token;
+
+    switch(token.kind) {
+        case EXPR_TOKEN_NUMBER:
+            expr_next_token(parser);
+            if(parser->token.kind == EXPR_TOKEN_DICE) return expr_parse_dice(parser, token.number);
+            expr_emit_constant(parser, token.number);
+            return (ExprNode){ .dice = -1 };
+
+        case EXPR_TOKEN_DICE:
+            return expr_parse_dice(parser, 1);
+
+        case EXPR_TOKEN_MINUS:
+            expr_next_token(parser);
+            expr_parse(parser, 40);
+            expr_emit(parser, EXPR_OP_NEG, 0);
+            return (ExprNode){ .dice = -1 };
+
+        case EXPR_TOKEN_OPEN:
+            expr_next_token(parser);
+            expr_parse(parser, 0);
+            if(parser->token.kind != EXPR_TOKEN_CLOSE) expr_fail(parser, parser->token.position, "expected ')'");
+            expr_next_token(parser);
+            return (ExprNode){ .dice = -1 };
+
+        case EXPR_TOKEN_END:
+            expr_fail(parser, token.position, "unexpected end of the roll");
+            return (ExprNode){ .dice = -1 };
+
+        default:
+            expr_fail(parser, token.position, "expected a number, dice or '('");
+            return (ExprNode){ .dice = -1 };
+    }
+}
+
+static int expr_infix_power(ExprTokenKind kind) {
+    switch(kind) {
+        case EXPR_TOKEN_CMP:   return 10;
+        case EXPR_TOKEN_PLUS:
+        case EXPR_TOKEN_MINUS: return 20;
+        case EXPR_TOKEN_STAR:  return 30;
+        default:               return 0;
+    }
+}
+
+// Pratt parser, operators only take over the left side when they bind tighter than min_power
+static ExprNode expr_parse(ExprParser *parser, int min_power) {
+    // Every '(' and unary '-' is one more call deep, so the text alone could run the C stack out
+    if(parser->nesting >= EXPR_MAX_STACK) {
+        expr_fail(parser, parser->token.position, "expression is nested too deep");
+        return (ExprNode){ .dice = -1 };
+    }
+    parser->nesting++;
+
+    ExprNode left = expr_parse_prefix(parser);
+
+    while(!parser->failed) {
+        ExprToken op    = parser->token;
+        int       power = expr_infix_power(op.kind);
+        if(power <= min_power) break;
+
+        expr_next_token(parser);
+        size_t right_start = parser->expr->op_count;
+        expr_parse(parser, power);
+
+        int64_t target;
+        switch(op.kind) {
+            case EXPR_TOKEN_PLUS:  expr_emit(parser, EXPR_OP_ADD, 0); break;
+            case EXPR_TOKEN_MINUS: expr_emit(parser, EXPR_OP_SUB, 0); break;
+            case EXPR_TOKEN_STAR:  expr_emit(parser, EXPR_OP_MUL, 0); break;
+
+            case EXPR_TOKEN_CMP: {
+                ExprDice *dice = left.dice >= 0 ? &parser->expr->dice[left.dice] : NULL;
+                if(dice != NULL && dice->count_cmp == EXPR_CMP_NONE && !dice->explode && !parser->failed && expr_fold_constant(parser, right_start, &target)) {
+                    // Dice against a constant counts the dice that pass
+                    dice->count_cmp      = op.cmp;
+                    dice->count_target   = target;
+                    parser->expr->op_count = right_start;
+                    parser->depth--;
+                } else {
+                    expr_emit(parser, EXPR_OP_CMP, op.cmp);
+                }
+            } break;
+
+            default: break;
+        }
+
+        left = (ExprNode){ .dice = -1 };
+    }
+
+    parser->nesting--;
+    return left;
+}
+
+bool expr_compile(Expr *expr, const char *text, ExprError *error) {
+    *expr = (Expr){0};
+
+    ExprParser parser = { .text = text, .expr = expr };
+    expr_next_token(&parser);
+
+    if(parser.token.kind == EXPR_TOKEN_END) expr_fail(&parser, 0, "the roll is empty");
+
+    expr_parse(&parser, 0);
+    if(parser.token.kind != EXPR_TOKEN_END) expr_fail(&parser, parser.token.position, "unexpected text after the roll");
+
+    if(parser.failed) {
+        if(error != NULL) *error = parser.error;
+        expr_free(expr);
+        return false;
+    }
+
+    // Compiled rolls tend to live as long as the macro holding them, so the slack the
+    // arrays grew with goes back
+    expr->ops         = realloc(expr->ops, expr->op_count * sizeof(*expr->ops));
+    expr->op_capacity = expr->op_count;
+    if(expr->dice_count > 0) {
+        expr->dice          = realloc(expr->dice, expr->dice_count * sizeof(*expr->dice));
+        expr->dice_capacity = expr->dice_count;
+    }
+    if(expr->constant_count > 0) {
+        expr->constants         = realloc(expr->constants, expr->constant_count * sizeof(*expr->constants));
+        expr->constant_capacity = expr->constant_count;
+    }
+
+    return true;
+}
+
+// Below this many dice per side they get rolled one by one, above it the face
+// counts are drawn from the multinomial distribution in O(sides)
+#define EXPR_MULTINOMIAL_DICE_PER_SIDE 16
+
+static void expr_roll_counts(Rng *rng, uint32_t amount, uint32_t sides, uint64_t *counts) {
+    memset(counts, 0, (sides + 1) * sizeof(*counts));
+
+    if(amount > EXPR_MULTINOMIAL_DICE_PER_SIDE * sides) {
+        rng_multinomial_dice(rng, amount, sides, counts);
+        return;
+    }
+
+    uint8_t dice[4096];
+    for(uint32_t done = 0; done < amount; ) {
+        uint32_t batch = amount - done < sizeof(dice) ? amount - done : (uint32_t)sizeof(dice);
+        rng_fill_dice(rng, dice, batch, sides);
+        kernel_face_counts_u8(dice, batch, sides, counts);
+        done += batch;
+    }
+}
+
+// Face counts of amount dice after their rerolls, which are rolled together as
+// another histogram for as long as any dice are left to reroll
+static void expr_roll_faces(const ExprDice *dice, Rng *rng, uint32_t amount, uint64_t *counts) {
+    expr_roll_counts(rng, amount, dice->sides, counts);
+    if(dice->reroll_cmp == EXPR_CMP_NONE) return;
+
+    uint64_t again[EXPR_MAX_SIDES + 1];
+    for(;;) {
+        uint64_t rerolled = 0;
+        for(uint32_t face = 1; face <= dice->sides; face++) {
+            if(!expr_rerolls(dice, face)) continue;
+            rerolled    += counts[face];
+            counts[face] = 0;
+        }
+        if(rerolled == 0) break;
+
+        expr_roll_counts(rng, (uint32_t)rerolled, dice->sides, again);
+        for(uint32_t face = 1; face <= dice->sides; face++) counts[face] += again[face];
+
+        if(dice->reroll_once) break;
+    }
+}
+
+static int64_t expr_roll(const ExprDice *dice, Rng *rng) {
+    uint64_t counts[EXPR_MAX_SIDES + 1];
+    expr_roll_faces(dice, rng, dice->amount, counts);
+
+    if(dice->explode) {
+        // Every round the dice that came up highest roll again, all at once
+        int64_t total = 0;
+        for(int round = 0; ; round++) {
+            for(uint32_t face = 1; face <= dice->sides; face++) total += (int64_t)(counts[face] * face);
+
+            uint64_t exploding = counts[dice->sides];
+            if(exploding == 0 || round + 1 == EXPR_MAX_EXPLOSIONS) break;
+            expr_roll_faces(dice, rng, (uint32_t)exploding, counts);
+        }
+        return total;
+    }
+
+    // Keeping walks the histogram from the kept end and stops once enough dice are in
+    uint64_t left = dice->keep == EXPR_KEEP_ALL ? dice->amount : dice->keep_count;
+    int64_t  total = 0;
+
+    for(uint32_t i = 0; i < dice->sides && left > 0; i++) {
+        uint32_t face  = dice->keep == EXPR_KEEP_LOWEST ? i + 1 : dice->sides - i;
+        uint64_t taken = counts[face] < left ? counts[face] : left;
+        left -= taken;
+
+        if(dice->count_cmp != EXPR_CMP_NONE) {
+            if(expr_cmp_holds(dice->count_cmp, face, dice->count_target)) total += (int64_t)taken;
+        } else {
+            total += (int64_t)(taken * face);
+        }
+    }
+
+    return total;
+}
+
+// Arithmetic wraps instead of overflowing, which is undefined for signed integers
+static int64_t expr_run(const Expr *expr, size_t start, size_t end, Rng *rng) {
+    int64_t stack[EXPR_MAX_STACK];
+    size_t  top = 0;
+
+    for(size_t i = start; i < end; i++) {
+        ExprOp op = expr->ops[i];
+
+        switch(op.code) {
+            case EXPR_OP_CONST: stack[top++] = expr->constants[op.arg];          break;
+            case EXPR_OP_DICE:  stack[top++] = expr_roll(&expr->dice[op.arg], rng); break;
+            case EXPR_OP_NEG:   stack[top - 1] = (int64_t)(0 - (uint64_t)stack[top - 1]); break;
+
+            case EXPR_OP_ADD: top--; stack[top - 1] = (int64_t)((uint64_t)stack[top - 1] + (uint64_t)stack[top]); break;
+            case EXPR_OP_SUB: top--; stack[top - 1] = (int64_t)((uint64_t)stack[top - 1] - (uint64_t)stack[top]); break;
+            case EXPR_OP_MUL: top--; stack[top - 1] = (int64_t)((uint64_t)stack[top - 1] * (uint64_t)stack[top]); break;
+            case EXPR_OP_CMP: top--; stack[top - 1] = expr_cmp_holds((ExprCmp)op.arg, stack[top - 1], stack[top]); break;
+        }
+    }
+
+    return top > 0 ? stack[top - 1] : 0;
+}
+
+int64_t expr_eval(const Expr *expr, Rng *rng) {
+    return expr_run(expr, 0, expr->op_count, rng);
+}
+
+#define EXPR_BATCH_DICE 4096
+
+// One dice term for count rolls. Sums, counts and keeps of few dice are filled for as
+// many rolls as fit in one go, rerolls, explosions and big amounts go through the
+// histogram one roll at a time.
+static void expr_roll_batch(const ExprDice *dice, Rng *rng, int64_t *out, size_t count) {
+    bool fillable = dice->reroll_cmp == EXPR_CMP_NONE && !dice->explode
+                 && dice->amount > 0 && dice->amount <= EXPR_MULTINOMIAL_DICE_PER_SIDE * dice->sides
+                 && dice->amount <= EXPR_BATCH_DICE;
+    if(!fillable) {
+        for(size_t i = 0; i < count; i++) out[i] = expr_roll(dice, rng);
+        return;
+    }
+
+    // What a die showing each face adds to the roll
+    uint8_t value[EXPR_MAX_SIDES + 1];
+    for(uint32_t face = 1; face <= dice->sides; face++)
+        value[face] = dice->count_cmp != EXPR_CMP_NONE ? expr_cmp_holds(dice->count_cmp, face, dice->count_target) : (uint8_t)face;
+
+    uint8_t  rolled[EXPR_BATCH_DICE];
+    uint32_t counts[EXPR_MAX_SIDES + 1] = {0};
+    size_t   per_fill = EXPR_BATCH_DICE / dice->amount;
+
+    for(size_t done = 0; done < count; ) {
+        size_t rolls = count - done < per_fill ? count - done : per_fill;
+        rng_fill_dice(rng, rolled, rolls * dice->amount, dice->sides);
+
+        for(size_t i = 0; i < rolls; i++) {
+            const uint8_t *die   = rolled + i * dice->amount;
+            int64_t        total = 0;
+
+            if(dice->keep == EXPR_KEEP_ALL) {
+                for(uint32_t d = 0; d < dice->amount; d++) total += value[die[d]];
+            } else {
+                // Same walk from the kept end as expr_roll, over counts that only
+                // ever hold this roll's dice
+                for(uint32_t d = 0; d < dice->amount; d++) counts[die[d]]++;
+
+                uint32_t left = dice->keep_count;
+                for(uint32_t f = 0; f < dice->sides && left > 0; f++) {
+                    uint32_t face  = dice->keep == EXPR_KEEP_LOWEST ? f + 1 : dice->sides - f;
+                    uint32_t taken = counts[face] < left ? counts[face] : left;
+                    left  -= taken;
+                    total += (int64_t)taken * value[face];
+                }
+
+                for(uint32_t d = 0; d < dice->amount; d++) counts[die[d]] = 0;
+            }
+
+            out[done + i] = total;
+        }
+        done += rolls;
+    }
+}
+
+void expr_eval_batch(const Expr *expr, Rng *rng, int64_t *out, size_t n) {
+    int64_t stack[EXPR_MAX_STACK][EXPR_BATCH];
+
+    for(size_t done = 0; done < n; done += EXPR_BATCH) {
+        size_t count = n - done < EXPR_BATCH ? n - done : EXPR_BATCH;
+        size_t top   = 0;
+
+        for(size_t i = 0; i < expr->op_count; i++) {
+            ExprOp   op = expr->ops[i];
+            int64_t *a  = stack[top > 1 ? top - 2 : 0];
+            int64_t *b  = stack[top > 0 ? top - 1 : 0];
+
+            switch(op.code) {
+                case EXPR_OP_CONST:
+                    for(size_t r = 0; r < count; r++) stack[top][r] = expr->constants[op.arg];
+                    top++;
+                    break;
+
+                case EXPR_OP_DICE: expr_roll_batch(&expr->dice[op.arg], rng, stack[top++], count); break;
+                case EXPR_OP_NEG:  for(size_t r = 0; r < count; r++) b[r] = (int64_t)(0 - (uint64_t)b[r]); break;
+
+                case EXPR_OP_ADD: for(size_t r = 0; r < count; r++) a[r] = (int64_t)((uint64_t)a[r] + (uint64_t)b[r]); top--; break;
+                case EXPR_OP_SUB: for(size_t r = 0; r < count; r++) a[r] = (int64_t)((uint64_t)a[r] - (uint64_t)b[r]); top--; break;
+                case EXPR_OP_MUL: for(size_t r = 0; r < count; r++) a[r] = (int64_t)((uint64_t)a[r] * (uint64_t)b[r]); top--; break;
+                case EXPR_OP_CMP: for(size_t r = 0; r < count; r++) a[r] = expr_cmp_holds((ExprCmp)op.arg, a[r], b[r]); top--; break;
+            }
+        }
+
+        if(top > 0) memcpy(out + done, stack[top - 1], count * sizeof(*out));
+        else        memset(out + done, 0, count * sizeof(*out));
+    }
+}
+
+bool expr_plain_dice(const Expr *expr, ExprDice *dice) {
+    if(expr->op_count != 1 || expr->ops[0].code != EXPR_OP_DICE) return false;
+
+    const ExprDice *term = &expr->dice[expr->ops[0].arg];
+    if(term->keep != EXPR_KEEP_ALL || term->count_cmp != EXPR_CMP_NONE || term->reroll_cmp != EXPR_CMP_NONE || term->explode) return false;
+
+    *dice = *term;
+    return true;
+}
+
+static uint64_t expr_dice_hash(const ExprDice *dice) {
+    uint64_t fields[] = {
+        dice->amount,     dice->sides,                  dice->keep,        dice->keep_count,
+        dice->count_cmp,  (uint64_t)dice->count_target, dice->reroll_cmp,  (uint64_t)dice->reroll_target,
+        dice->reroll_once, dice->explode,
+    };
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for(size_t i = 0; i < sizeof(fields)/sizeof(fields[0]); i++) {
+        hash ^= fields[i];
+        hash *= 0x100000001b3ULL;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+static bool expr_dice_equal(const ExprDice *a, const ExprDice *b) {
+    return a->amount    == b->amount    && a->sides      == b->sides      && a->keep         == b->keep
+        && a->keep_count == b->keep_count && a->count_cmp == b->count_cmp && a->count_target == b->count_target
+        && a->reroll_cmp == b->reroll_cmp && a->reroll_target == b->reroll_target && a->reroll_once == b->reroll_once
+        && a->explode == b->explode;
+}
+
+// One exploding die goes k rounds deep and stops on a face v below the highest with
+// chance again^k * chances[v]. Rounds stop once amount dice together would leave out
+// no more than tolerance, amount * again^(depth + 1) <= tolerance.
+static bool expr_explode_distribution(const ExprDice *dice, const double *chances, double tolerance, DiceDist *dist, const char **error) {
+    uint32_t sides = dice->sides;
+    double   again = chances[sides];
+
+    uint64_t depth = 0;
+    if(again > 0.0) {
+        double rounds = ceil(log(tolerance / (double)dice->amount) / log(again));
+        depth = rounds > 1.0 ? (uint64_t)rounds - 1 : 0;
+    }
+
+    // Values 1 up to depth * sides + sides - 1
+    uint64_t count = (depth + 1) * sides - 1;
+    if(depth >= EXPR_DIST_MAX_COUNT || (uint64_t)dice->amount * (count - 1) >= EXPR_DIST_MAX_COUNT) {
+        *error = "too many possible results";
+        return false;
+    }
+
+    DiceDist die = { .min = 1, .count = count, .pmf = calloc(count, sizeof(double)) };
+    double reach = 1.0;
+    for(uint64_t k = 0; k <= depth; k++) {
+        for(uint32_t face = 1; face < sides; face++) die.pmf[k * sides + face - 1] = reach * chances[face];
+        reach *= again;
+    }
+
+    dist_repeat(dist, &die, dice->amount);
+    free(die.pmf);
+    return true;
+}
+
+static bool expr_dice_distribution(const ExprDice *dice, double tolerance, DiceDist *dist, const char **error) {
+    double chances[EXPR_MAX_SIDES + 1];
+    expr_face_chances(dice, chances);
+    bool rerolls = dice->reroll_cmp != EXPR_CMP_NONE;
+
+    if(dice->explode) return expr_explode_distribution(dice, chances, tolerance, dist, error);
+
+    if(dice->keep != EXPR_KEEP_ALL) {
+        // A kept die adds its face, or 1 when counting and it passes
+        uint32_t values[EXPR_MAX_SIDES + 1];
+        for(uint32_t face = 1; face <= dice->sides; face++)
+            values[face] = dice->count_cmp == EXPR_CMP_NONE ? face : expr_cmp_holds(dice->count_cmp, face, dice->count_target);
+
+        if(!dist_keep(dist, dice->amount, dice->sides, dice->keep_count, dice->keep == EXPR_KEEP_HIGHEST, values,
+                      rerolls ? chances : NULL, EXPR_DIST_MAX_COUNT)) {
+            *error = "too many dice to keep exactly";
+            return false;
+        }
+        return true;
+    }
+
+    if(dice->count_cmp != EXPR_CMP_NONE) {
+        double passing = 0.0;
+        for(uint32_t face = 1; face <= dice->sides; face++)
+            if(expr_cmp_holds(dice->count_cmp, face, dice->count_target)) passing += chances[face];
+        dist_successes(dist, dice->amount, passing);
+        return true;
+    }
+
+    if((uint64_t)dice->amount * (dice->sides - 1) >= EXPR_DIST_MAX_COUNT) {
+        *error = "too many possible results";
+        return false;
+    }
+
+    if(!rerolls) {
+        dist_dice_sum(dist, dice->amount, dice->sides);
+        return true;
+    }
+
+    DiceDist die = { .min = 1, .count = dice->sides, .pmf = chances + 1 };
+    dist_repeat(dist, &die, dice->amount);
+    return true;
+}
+
+static void expr_dist_cache_insert(ExprDistCache *cache, ExprDistEntry entry) {
+    size_t slot = expr_dice_hash(&entry.key) & (cache->capacity - 1);
+    while(cache->entries[slot].dist != NULL) slot = (slot + 1) & (cache->capacity - 1);
+    cache->entries[slot] = entry;
+}
+
+static const DiceDist *expr_dist_cache_get(ExprDistCache *cache, const ExprDice *dice, const char **error) {
+    if(cache->capacity > 0) {
+        for(size_t slot = expr_dice_hash(dice) & (cache->capacity - 1); cache->entries[slot].dist != NULL; slot = (slot + 1) & (cache->capacity - 1)) {
+            if(expr_dice_equal(&cache->entries[slot].key, dice)) {
+                cache->hits++;
+                return cache->entries[slot].dist;
+            }
+        }
+    }
+
+    DiceDist computed = {0};
+    double tolerance = cache->tolerance > 0.0 ? cache->tolerance : EXPR_DIST_TOLERANCE;
+    if(!expr_dice_distribution(dice, tolerance, &computed, error)) return NULL;
+    cache->misses++;
+
+    // Kept at most half full so probes stay short
+    if((cache->count + 1) * 2 > cache->capacity) {
+        ExprDistEntry *old          = cache->entries;
+        size_t         old_capacity = cache->capacity;
+
+        cache->capacity = old_capacity == 0 ? 16 : old_capacity * 2;
+        cache->entries  = calloc(cache->capacity, sizeof(*cache->entries));
+        for(size_t i = 0; i < old_capacity; i++)
+            if(old[i].dist != NULL) expr_dist_cache_insert(cache, old[i]);
+        free(old);
+    }
+
+    DiceDist *dist = malloc(sizeof(*dist));
+    *dist = computed;
+    expr_dist_cache_insert(cache, (ExprDistEntry){ .key = *dice, .dist = dist });
+    cache->count++;
+
+    return dist;
+}
+
+void expr_dist_cache_free(ExprDistCache *cache) {
+    for(size_t i = 0; i < cache->capacity; i++) {
+        if(cache->entries[i].dist == NULL) continue;
+        dist_free(cache->entries[i].dist);
+        free(cache->entries[i].dist);
+    }
+    free(cache->entries);
+    *cache = (ExprDistCache){0};
+}
+
+// A stack entry either owns its distribution or borrows one from the cache
+typedef struct ExprDistSlot {
+    DiceDist        owned;
+    const DiceDist *borrowed;
+} ExprDistSlot;
+
+static const DiceDist *expr_slot_dist(const ExprDistSlot *slot) {
+    return slot->borrowed != NULL ? slot->borrowed : &slot->owned;
+}
+
+static void expr_slot_release(ExprDistSlot *slot) {
+    if(slot->borrowed == NULL) dist_free(&slot->owned);
+    *slot = (ExprDistSlot){0};
+}
+
+bool expr_distribution(const Expr *expr, ExprDistCache *cache, DiceDist *dist, const char **error) {
+    const char *ignored;
+    if(error == NULL) error = &ignored;
+
+    ExprDistSlot stack[EXPR_MAX_STACK] = {0};
+    size_t top = 0;
+    bool   ok  = true;
+
+    for(size_t i = 0; i < expr->op_count && ok; i++) {
+        ExprOp   op     = expr->ops[i];
+        DiceDist result = {0};
+
+        switch(op.code) {
+            case EXPR_OP_CONST:
+                dist_constant(&stack[top++].owned, expr->constants[op.arg]);
+                continue;
+
+            case EXPR_OP_DICE:
+                stack[top].borrowed = expr_dist_cache_get(cache, &expr->dice[op.arg], error);
+                ok = stack[top++].borrowed != NULL;
+                continue;
+
+            case EXPR_OP_NEG:
+                dist_negate(&result, expr_slot_dist(&stack[top - 1]));
+                expr_slot_release(&stack[top - 1]);
+                stack[top - 1].owned = result;
+                continue;
+        }
+
+        const DiceDist *a = expr_slot_dist(&stack[top - 2]);
+        const DiceDist *b = expr_slot_dist(&stack[top - 1]);
+
+        if(op.code == EXPR_OP_MUL) {
+            ok = dist_product(&result, a, b, EXPR_DIST_MAX_COUNT);
+        } else if(a->count + b->count - 1 > EXPR_DIST_MAX_COUNT) {
+            ok = false;
+        } else if(op.code == EXPR_OP_ADD) {
+            dist_convolve(&result, a, b);
+        } else {
+            // a - b and comparisons of a and b both go through the distribution of a + (-b)
+            DiceDist negated = {0};
+            dist_negate(&negated, b);
+            dist_convolve(&result, a, &negated);
+            dist_free(&negated);
+
+            if(op.code == EXPR_OP_CMP) {
+                double p;
+                switch((ExprCmp)op.arg) {
+                    case EXPR_CMP_GE: p = dist_at_least(&result, 0);       break;
+                    case EXPR_CMP_GT: p = dist_at_least(&result, 1);       break;
+                    case EXPR_CMP_LE: p = dist_cdf(&result, 0);            break;
+                    case EXPR_CMP_LT: p = dist_cdf(&result, -1);           break;
+                    case EXPR_CMP_EQ: p = dist_pmf(&result, 0);            break;
+                    default:          p = 1.0 - dist_pmf(&result, 0);      break;
+                }
+                dist_free(&result);
+                dist_bernoulli(&result, p);
+            }
+        }
+
+        if(!ok) *error = "too many possible results";
+
+        expr_slot_release(&stack[top - 1]);
+        expr_slot_release(&stack[top - 2]);
+        top--;
+        stack[top - 1].owned = result;
+    }
+
+    if(ok && top == 1) {
+        if(stack[0].borrowed != NULL) dist_copy(dist, stack[0].borrowed);
+        else                          *dist = stack[0].owned;
+        return true;
+    }
+
+    while(top > 0) expr_slot_release(&stack[--top]);
+    return false;
+}
+
+void expr_free(Expr *expr) {
+    free(expr->ops);
+    free(expr->dice);
+    free(expr->constants);
+    *expr = (Expr){0};
+}
+
+void expr_copy(Expr *expr, const Expr *from) {
+    *expr = (Expr) {
+        .ops               = malloc(from->op_count * sizeof(*from->ops)),
+        .op_count          = from->op_count,
+        .op_capacity       = from->op_count,
+        .dice              = malloc(from->dice_count * sizeof(*from->dice)),
+        .dice_count        = from->dice_count,
+        .dice_capacity     = from->dice_count,
+        .constants         = malloc(from->constant_count * sizeof(*from->constants)),
+        .constant_count    = from->constant_count,
+        .constant_capacity = from->constant_count,
+    };
+    if(from->op_count       > 0) memcpy(expr->ops,       from->ops,       from->op_count       * sizeof(*from->ops));
+    if(from->dice_count     > 0) memcpy(expr->dice,      from->dice,      from->dice_count     * sizeof(*from->dice));
+    if(from->constant_count > 0) memcpy(expr->constants, from->constants, from->constant_count * sizeof(*from->constants));
+}
+
+// Walks the code the way expr_run does, without running anything
+bool expr_check(const Expr *expr) {
+    size_t depth = 0;
+
+    for(size_t i = 0; i < expr->op_count; i++) {
+        ExprOp op = expr->ops[i];
+
+        switch(op.code) {
+            case EXPR_OP_CONST:
+                if(op.arg >= expr->constant_count) return false;
+                depth++;
+                break;
+
+            case EXPR_OP_DICE: {
+                if(op.arg >= expr->dice_count) return false;
+                // A bool byte other than 0 or 1 cannot even be read, so look at the bytes first
+                const ExprDice *dice = &expr->dice[op.arg];
+                uint8_t reroll_once, explode;
+                memcpy(&reroll_once, &dice->reroll_once, 1);
+                memcpy(&explode,     &dice->explode,     1);
+                if(reroll_once > 1 || explode > 1 || expr_dice_problem(dice) != NULL) return false;
+                depth++;
+            } break;
+
+            case EXPR_OP_NEG:
+                if(depth < 1) return false;
+                break;
+
+            case EXPR_OP_CMP:
+                if(op.arg < EXPR_CMP_GE || op.arg > EXPR_CMP_NE) return false;
+                // fallthrough
+            case EXPR_OP_ADD:
+            case EXPR_OP_SUB:
+            case EXPR_OP_MUL:
+                if(depth < 2) return false;
+                depth--;
+                break;
+
+            default: return false;
+        }
+
+        if(depth > EXPR_MAX_STACK) return false;
+    }
+
+    return depth == 1;
+}
+
+#endif // EXPR_IMPLEMENTATION
@@ -0,0 +1,348 @@
+#ifndef GRID_H
+#define GRID_H
+
+// Layout and instanced drawing of the dice grid.
+//
+// Where every die goes only depends on the area the grid gets, the size of a die and
+// how many dice there are. GridLayout works the positions out once and keeps them
+// until one of those changes, so a frame only streams through the array.
+//
+// The grid can be far taller than the screen. Rows are all the same height, so the
+// layout only holds positions for one screenful of slots starting at the top. A
+// GridView scrolled to any height picks the rows that are on screen and the
+// distance to move the slots down by, which keeps the work per frame the same from
+// a thousand dice to ten million.
+//
+// Drawing a die as a textured quad makes rlgl build its 4 vertices on the CPU every
+// frame, which for 10^5-10^6 dice costs more than everything else in the frame put
+// together. GridRenderer draws every die as one instance of a shared unit quad
+// instead. It keeps two GPU buffers: the layout positions, uploaded only when the
+// layout changes, and one byte per die for its value, uploaded only when the dice
+// change. A whole frame of dice is one draw call. Anything that moves all dice at
+// once, like the wiggle, is a uniform.
+//
+// The faces are expected side by side in one atlas texture, face i starting
+// stride * i pixels right of the first one.
+//
+// Instancing needs OpenGL 3.3 or ES 3.0. On anything older grid_renderer_init
+// returns false and the dice have to be drawn one by one.
+//
+// #define GRID_IMPLEMENTATION in exactly one file before including this, raylib.h,
+// raymath.h and rlgl.h have to be included first.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef struct GridLayout {
+    // What the positions were worked out for
+    Rectangle area;
+    float     dice_size;
+    size_t    count;
+
+    Rectangle bounds;    // area minus the outer padding, die 0 goes in its corner
+    float     step;      // from one die to the next, across and down
+    size_t    per_row;
+    size_t    rows;      // rows the whole grid takes
+    double    height;    // of the whole grid, padding included, too far down for a float
+    size_t    slots;     // dice that fit on screen at once
+    Vector2  *positions; // top left corner of the slots when scrolled to the top
+    size_t    capacity;
+    uint64_t  version;   // bumped whenever the positions change
+} GridLayout;
+
+// The dice on screen when the top of the area is scrolled down to top, dice
+// [first, first + count) go in the first count slots moved down by offset. Drawing
+// the slots where they are and scrolling by top - offset keeps the coordinates
+// that reach the GPU small.
+typedef struct GridView {
+    size_t first;
+    size_t count;
+    double offset;
+} GridView;
+
+bool     grid_layout_update(GridLayout *layout, Rectangle area, float dice_size, size_t count); // true if it changed
+GridView grid_layout_view(const GridLayout *layout, double top);
+double   grid_layout_max_scroll(const GridLayout *layout);
+void     grid_layout_free(GridLayout *layout);
+
+typedef struct GridRenderer {
+    bool         ready;
+    unsigned int shader;
+    unsigned int vao;
+    unsigned int quad_vbo;
+    unsigned int position_vbo;
+    unsigned int value_vbo;
+    size_t       position_capacity; // entries the buffers have room for
+    size_t       value_capacity;
+    size_t       position_count;    // entries uploaded
+    size_t       value_count;
+
+    int          loc_vertex;
+    int          loc_position;
+    int          loc_value;
+    int          loc_mvp;
+    int          loc_offset;
+    int          loc_size;
+    int          loc_face;
+    int          loc_texture;
+
+    Texture      atlas;
+    Rectangle    first_face;
+    float        stride;
+} GridRenderer;
+
+bool grid_renderer_init(GridRenderer *grid, Texture atlas, Rectangle first_face, float stride);
+void grid_renderer_upload_positions(GridRenderer *grid, const Vector2 *positions, size_t count);
+void grid_renderer_upload_values(GridRenderer *grid, const uint8_t *values, size_t count); // die values, 1 based
+void grid_renderer_draw(GridRenderer *grid, Vector2 offset); // flushes whatever rlgl has batched first
+void grid_renderer_free(GridRenderer *grid);
+
+#endif // GRID_H
+
+#ifdef GRID_IMPLEMENTATION
+#undef GRID_IMPLEMENTATION
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+bool grid_layout_update(GridLayout *layout, Rectangle area, float dice_size, size_t count) {
+    if(layout->positions != NULL && layout->count == count && layout->dice_size == dice_size &&
+       layout->area.x == area.x && layout->area.y == area.y &&
+       layout->area.width == area.width && layout->area.height == area.height) return false;
+
+    layout->area      = area;
+    layout->dice_size = dice_size;
+    layout->count     = count;
+
+    float padding = area.width / 20;
+    layout->bounds = (Rectangle){
+        .x      = area.x + padding,
+        .y      = area.y + padding,
+        .width  = area.width  - padding * 2,
+        .height = area.height - padding * 2,
+    };
+
+    // Whatever is left of a row is spread between the dice
+    float per_row_raw = layout->bounds.width / dice_size;
+    float per_row     = floorf(per_row_raw);
+    if(per_row < 1) per_row = 1;
+    float inner_padding = per_row > 1 ? (per_row_raw - per_row) * dice_size / (per_row - 1) : 0.0f;
+
+    layout->step    = dice_size + inner_padding;
+    layout->per_row = (size_t)per_row;
+    layout->rows    = (count + layout->per_row - 1) / layout->per_row;
+    layout->height  = padding * 2 + (double)layout->rows * layout->step;
+
+    // A row scrolled partly out at the top leaves room for one more at the bottom
+    size_t screen_rows = (size_t)ceilf(area.height / layout->step) + 1;
+    layout->slots = screen_rows * layout->per_row;
+    if(layout->slots > count) layout->slots = count;
+
+    if(layout->slots > layout->capacity || layout->positions == NULL) {
+        layout->capacity  = layout->slots > 0 ? layout->slots : 1;
+        layout->positions = realloc(layout->positions, layout->capacity * sizeof(*layout->positions));
+    }
+
+    for(size_t i = 0; i < layout->slots; i++) {
+        layout->positions[i] = (Vector2){
+            .x = layout->bounds.x + (float)(i % layout->per_row) * layout->step,
+            .y = layout->bounds.y + (float)(i / layout->per_row) * layout->step,
+        };
+    }
+
+    layout->version++;
+    return true;
+}
+
+GridView grid_layout_view(const GridLayout *layout, double top) {
+    GridView view = {0};
+
+    size_t first_row = 0;
+    if(top > layout->bounds.y) first_row = (size_t)((top - layout->bounds.y) / layout->step);
+    if(first_row >= layout->rows) return view;
+
+    view.first  = first_row * layout->per_row;
+    view.count  = layout->count - view.first;
+    if(view.count > layout->slots) view.count = layout->slots;
+    view.offset = (double)first_row * layout->step;
+
+    return view;
+}
+
+double grid_layout_max_scroll(const GridLayout *layout) {
+    double max = layout->height - layout->area.height;
+    return max > 0 ? max : 0;
+}
+
+void grid_layout_free(GridLayout *layout) {
+    free(layout->positions);
+    *layout = (GridLayout){0};
+}
+
+static const char *grid_vertex_shader =
+    "in vec2 vertexPosition;\n"
+    "in vec2 position;\n"
+    "in float value;\n"
+    "uniform mat4 mvp;\n"
+    "uniform vec2 offset;\n"
+    "uniform vec2 size;\n"
+    "uniform vec4 face;\n" // first face u, u between faces, face width in u, face height in v
+    "out vec2 fragTexCoord;\n"
+    "void main() {\n"
+    "    fragTexCoord = vec2(face.x + (value - 1.0) * face.y + vertexPosition.x * face.z, vertexPosition.y * face.w);\n"
+    "    gl_Position  = mvp * vec4(position + offset + vertexPosition * size, 0.0, 1.0);\n"
+    "}\n";
+
+static const char *grid_fragment_shader =
+    "in vec2 fragTexCoord;\n"
+    "uniform sampler2D texture0;\n"
+    "out vec4 finalColor;\n"
+    "void main() {\n"
+    "    finalColor = texture(texture0, fragTexCoord);\n"
+    "}\n";
+
+// Two triangles covering [0, 1]^2
+static const float grid_quad[] = {
+    0.0f, 0.0f,  0.0f, 1.0f,  1.0f, 1.0f,
+    0.0f, 0.0f,  1.0f, 1.0f,  1.0f, 0.0f,
+};
+
+bool grid_renderer_init(GridRenderer *grid, Texture atlas, Rectangle first_face, float stride) {
+    *grid = (GridRenderer){ .atlas = atlas, .first_face = first_face, .stride = stride };
+
+    const char *header;
+    switch(rlGetVersion()) {
+        case RL_OPENGL_33:
+        case RL_OPENGL_43:    header = "#version 330\n"; break;
+        case RL_OPENGL_ES_30: header = "#version 300 es\nprecision mediump float;\n"; break;
+        default:              return false;
+    }
+
+    char vertex[1024];
+    char fragment[512];
+    snprintf(vertex,   sizeof(vertex),   "%s%s", header, grid_vertex_shader);
+    snprintf(fragment, sizeof(fragment), "%s%s", header, grid_fragment_shader);
+
+    grid->shader = rlLoadShaderCode(vertex, fragment);
+    if(grid->shader == 0 || grid->shader == rlGetShaderIdDefault()) return false;
+
+    grid->loc_vertex   = rlGetLocationAttrib(grid->shader, "vertexPosition");
+    grid->loc_position = rlGetLocationAttrib(grid->shader, "position");
+    grid->loc_value    = rlGetLocationAttrib(grid->shader, "value");
+    grid->loc_mvp      = rlGetLocationUniform(grid->shader, "mvp");
+    grid->loc_offset   = rlGetLocationUniform(grid->shader, "offset");
+    grid->loc_size     = rlGetLocationUniform(grid->shader, "size");
+    grid->loc_face     = rlGetLocationUniform(grid->shader, "face");
+    grid->loc_texture  = rlGetLocationUniform(grid->shader, "texture0");
+
+    grid->vao = rlLoadVertexArray();
+    if(grid->vao == 0 || grid->loc_vertex < 0 || grid->loc_position < 0 || grid->loc_value < 0) {
+        grid_renderer_free(grid);
+        return false;
+    }
+
+    rlEnableVertexArray(grid->vao);
+
+    grid->quad_vbo = rlLoadVertexBuffer(grid_quad, sizeof(grid_quad), false);
+    rlSetVertexAttribute(grid->loc_vertex, 2, RL_FLOAT, false, 0, 0);
+    rlEnableVertexAttribute(grid->loc_vertex);
+
+    rlDisableVertexArray();
+
+    grid->ready = true;
+    return true;
+}
+
+// Uploads into a per instance buffer, which is replaced by a bigger one when it runs out
+static void grid_upload(GridRenderer *grid, unsigned int *vbo, size_t *capacity, int location,
+                        int components, int type, size_t size, const void *data, size_t count) {
+    if(count == 0) return;
+
+    if(count <= *capacity) {
+        rlUpdateVertexBuffer(*vbo, data, (int)(count * size), 0);
+        return;
+    }
+
+    // Grown by half again so a pool that keeps growing does not reallocate every change
+    size_t grown = *capacity + *capacity / 2;
+    if(grown < count) grown = count;
+
+    rlEnableVertexArray(grid->vao);
+
+    if(*vbo != 0) rlUnloadVertexBuffer(*vbo);
+    *vbo = rlLoadVertexBuffer(NULL, (int)(grown * size), true);
+    rlUpdateVertexBuffer(*vbo, data, (int)(count * size), 0);
+
+    rlSetVertexAttribute(location, components, type, false, 0, 0);
+    rlSetVertexAttributeDivisor(location, 1);
+    rlEnableVertexAttribute(location);
+
+    rlDisableVertexArray();
+
+    *capacity = grown;
+}
+
+void grid_renderer_upload_positions(GridRenderer *grid, const Vector2 *positions, size_t count) {
+    if(!grid->ready) return;
+    grid_upload(grid, &grid->position_vbo, &grid->position_capacity, grid->loc_position,
+                2, RL_FLOAT, sizeof(*positions), positions, count);
+    grid->position_count = count;
+}
+
+void grid_renderer_upload_values(GridRenderer *grid, const uint8_t *values, size_t count) {
+    if(!grid->ready) return;
+    grid_upload(grid, &grid->value_vbo, &grid->value_capacity, grid->loc_value,
+                1, RL_UNSIGNED_BYTE, sizeof(*values), values, count);
+    grid->value_count = count;
+}
+
+void grid_renderer_draw(GridRenderer *grid, Vector2 offset) {
+    size_t count = grid->position_count < grid->value_count ? grid->position_count : grid->value_count;
+    if(!grid->ready || count == 0) return;
+
+    // Whatever was drawn before has to reach the screen first to stay underneath
+    rlDrawRenderBatchActive();
+
+    float width  = (float)grid->atlas.width;
+    float height = (float)grid->atlas.height;
+
+    float size[2] = { grid->first_face.width, grid->first_face.height };
+    float face[4] = {
+        grid->first_face.x / width,
+        grid->stride / width,
+        grid->first_face.width / width,
+        grid->first_face.height / height,
+    };
+    int texture_slot = 0;
+
+    rlEnableShader(grid->shader);
+    rlSetUniformMatrix(grid->loc_mvp, MatrixMultiply(rlGetMatrixModelview(), rlGetMatrixProjection()));
+    rlSetUniform(grid->loc_offset,  &offset,       RL_SHADER_UNIFORM_VEC2, 1);
+    rlSetUniform(grid->loc_size,    size,          RL_SHADER_UNIFORM_VEC2, 1);
+    rlSetUniform(grid->loc_face,    face,          RL_SHADER_UNIFORM_VEC4, 1);
+    rlSetUniform(grid->loc_texture, &texture_slot, RL_SHADER_UNIFORM_INT,  1);
+
+    rlActiveTextureSlot(texture_slot);
+    rlEnableTexture(grid->atlas.id);
+
+    rlEnableVertexArray(grid->vao);
+    rlDrawVertexArrayInstanced(0, 6, (int)count);
+    rlDisableVertexArray();
+
+    rlDisableTexture();
+    rlDisableShader();
+}
+
+void grid_renderer_free(GridRenderer *grid) {
+    if(grid->position_vbo != 0) rlUnloadVertexBuffer(grid->position_vbo);
+    if(grid->value_vbo != 0)    rlUnloadVertexBuffer(grid->value_vbo);
+    if(grid->quad_vbo != 0)     rlUnloadVertexBuffer(grid->quad_vbo);
+    if(grid->vao != 0)          rlUnloadVertexArray(grid->vao);
+    if(grid->shader != 0 && grid->shader != rlGetShaderIdDefault()) rlUnloadShaderProgram(grid->shader);
+
+    *grid = (GridRenderer){0};
+}
+
+#endif // GRID_IMPLEMENTATION
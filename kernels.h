@@ -0,0 +1,334 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+// Reduction kernels over the three ways a page of dice can be stored:
+//
+//   byte:   one die per byte, the value itself
+//   nibble: two dice per byte, die i is the low nibble of byte i/2 for even i and the
+//           high nibble for odd i, the value itself (0 means not rolled yet)
+//   base-6: six d6 per 16 bit word, die i is base-6 digit i%6 of word i/6 holding
+//           value - 1
+//
+// Every kernel works straight on the stored form without unpacking it first. They are
+// bound by memory bandwidth, which plain SSE2 already saturates, so there is no AVX2
+// variant. Face counts are added to counts[value], so pages can be accumulated.
+//
+// #define KERNELS_IMPLEMENTATION in exactly one file before including this.
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define BASE6_DICE_PER_WORD 6
+
+uint64_t kernel_sum_u8(const uint8_t *data, size_t n);
+void     kernel_face_counts_u8(const uint8_t *data, size_t n, uint32_t sides, uint64_t *counts);
+uint64_t kernel_count_at_least_u8(const uint8_t *data, size_t n, uint32_t threshold);
+
+uint64_t kernel_sum_nibble(const uint8_t *packed, size_t n);
+void     kernel_face_counts_nibble(const uint8_t *packed, size_t n, uint32_t sides, uint64_t *counts);
+uint64_t kernel_count_at_least_nibble(const uint8_t *packed, size_t n, uint32_t threshold);
+
+uint64_t kernel_sum_base6(const uint16_t *packed, size_t n);
+void     kernel_face_counts_base6(const uint16_t *packed, size_t n, uint64_t *counts);
+uint64_t kernel_count_at_least_base6(const uint16_t *packed, size_t n, uint32_t threshold);
+
+static inline uint32_t nibble_get(const uint8_t *packed, size_t index) {
+    return (packed[index / 2] >> ((index & 1) * 4)) & 0x0F;
+}
+
+static inline void nibble_set(uint8_t *packed, size_t index, uint32_t value) {
+    int shift = (index & 1) * 4;
+    packed[index / 2] = (uint8_t)((packed[index / 2] & ~(0x0F << shift)) | ((value & 0x0F) << shift));
+}
+
+static const uint16_t base6_powers[BASE6_DICE_PER_WORD] = { 1, 6, 36, 216, 1296, 7776 };
+
+static inline uint32_t base6_get(const uint16_t *packed, size_t index) {
+    return (packed[index / BASE6_DICE_PER_WORD] / base6_powers[index % BASE6_DICE_PER_WORD]) % 6 + 1;
+}
+
+static inline void base6_set(uint16_t *packed, size_t index, uint32_t value) {
+    uint16_t *word  = &packed[index / BASE6_DICE_PER_WORD];
+    uint16_t  power = base6_powers[index % BASE6_DICE_PER_WORD];
+    uint32_t  old   = (*word / power) % 6;
+    *word = (uint16_t)(*word - old * power + (value - 1) * power);
+}
+
+#endif // KERNELS_H
+
+#ifdef KERNELS_IMPLEMENTATION
+#undef KERNELS_IMPLEMENTATION
+
+#if defined(__SSE2__)
+    #define KERNELS_SSE2
+    #include <emmintrin.h>
+#endif
+
+#ifdef KERNELS_SSE2
+
+static inline uint64_t kernel_hsum_u8(__m128i v) {
+    uint64_t halves[2];
+    _mm_storeu_si128((__m128i*)halves, _mm_sad_epu8(v, _mm_setzero_si128()));
+    return halves[0] + halves[1];
+}
+
+static inline uint64_t kernel_hsum_u16(__m128i v) {
+    // Widened by hand, madd would treat the lanes as signed
+    __m128i wide = _mm_add_epi32(_mm_unpacklo_epi16(v, _mm_setzero_si128()), _mm_unpackhi_epi16(v, _mm_setzero_si128()));
+    uint32_t lanes[4];
+    _mm_storeu_si128((__m128i*)lanes, wide);
+    return (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+// Splits 16 packed bytes into the 16 low and the 16 high nibbles
+static inline void kernel_unpack_nibbles(__m128i v, __m128i *lo, __m128i *hi) {
+    __m128i mask = _mm_set1_epi8(0x0F);
+    *lo = _mm_and_si128(v, mask);
+    *hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+}
+
+// Splits 8 packed words into their 6 base-6 digits. w / 6 for any 16 bit w is
+// mulhi(w, 0xAAAB) >> 2.
+static inline void kernel_unpack_base6(__m128i w, __m128i digits[BASE6_DICE_PER_WORD]) {
+    __m128i magic = _mm_set1_epi16((short)0xAAAB);
+    __m128i six   = _mm_set1_epi16(6);
+    for(size_t k = 0; k < BASE6_DICE_PER_WORD; k++) {
+        __m128i q = _mm_srli_epi16(_mm_mulhi_epu16(w, magic), 2);
+        digits[k] = _mm_sub_epi16(w, _mm_mullo_epi16(q, six));
+        w = q;
+    }
+}
+
+#endif // KERNELS_SSE2
+
+uint64_t kernel_sum_u8(const uint8_t *data, size_t n) {
+    uint64_t total = 0;
+    size_t i = 0;
+
+#ifdef KERNELS_SSE2
+    __m128i acc = _mm_setzero_si128();
+    for(; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(v, _mm_setzero_si128()));
+    }
+
+    uint64_t halves[2];
+    _mm_storeu_si128((__m128i*)halves, acc);
+    total = halves[0] + halves[1];
+#endif
+
+    for(; i < n; i++) total += data[i];
+
+    return total;
+}
+
+void kernel_face_counts_u8(const uint8_t *data, size_t n, uint32_t sides, uint64_t *counts) {
+    size_t i = 0;
+
+#ifdef KERNELS_SSE2
+    // Per face byte counters, flushed before they can wrap
+    if(sides <= 16) {
+        __m128i acc[17];
+        while(i + 16 <= n) {
+            for(uint32_t f = 1; f <= sides; f++) acc[f] = _mm_setzero_si128();
+
+            for(size_t round = 0; round < 255 && i + 16 <= n; round++, i += 16) {
+                __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+                for(uint32_t f = 1; f <= sides; f++)
+                    acc[f] = _mm_sub_epi8(acc[f], _mm_cmpeq_epi8(v, _mm_set1_epi8((char)f)));
+            }
+
+            for(uint32_t f = 1; f <= sides; f++) counts[f] += kernel_hsum_u8(acc[f]);
+        }
+    }
+#endif
+
+    for(; i < n; i++)
+        if(data[i] <= sides) counts[data[i]]++;
+}
+
+uint64_t kernel_count_at_least_u8(const uint8_t *data, size_t n, uint32_t threshold) {
+    if(threshold == 0)  return n;
+    if(threshold > 255) return 0;
+
+    uint64_t total = 0;
+    size_t i = 0;
+
+#ifdef KERNELS_SSE2
+    // No unsigned byte compare in SSE2, but max(x, t) == x is the same as x >= t
+    __m128i at_least = _mm_set1_epi8((char)threshold);
+    while(i + 16 <= n) {
+        __m128i acc = _mm_setzero_si128();
+        for(size_t round = 0; round < 255 && i + 16 <= n; round++, i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+            acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(_mm_max_epu8(v, at_least), v));
+        }
+        total += kernel_hsum_u8(acc);
+    }
+#endif
+
+    for(; i < n; i++) total += data[i] >= threshold;
+
+    return total;
+}
+
+uint64_t kernel_sum_nibble(const uint8_t *packed, size_t n) {
+    uint64_t total = 0;
+    size_t i = 0;
+
+#ifdef KERNELS_SSE2
+    __m128i acc = _mm_setzero_si128();
+    for(; i + 32 <= n; i += 32) {
+        __m128i lo, hi;
+        kernel_unpack_nibbles(_mm_loadu_si128((const __m128i*)(packed + i / 2)), &lo, &hi);
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_add_epi8(lo, hi), _mm_setzero_si128()));
+    }
+
+    uint64_t halves[2];
+    _mm_storeu_si128((__m128i*)halves, acc);
+    total = halves[0] + halves[1];
+#endif
+
+    for(; i < n; i++) total += nibble_get(packed, i);
+
+    return total;
+}
+
+void kernel_face_counts_nibble(const uint8_t *packed, size_t n, uint32_t sides, uint64_t *counts) {
+    if(sides > 15) sides = 15;
+    size_t i = 0;
+
+#ifdef KERNELS_SSE2
+    __m128i acc[16];
+    while(i + 32 <= n) {
+        for(uint32_t f = 1; f <= sides; f++) acc[f] = _mm_setzero_si128();
+
+        // Two nibbles per byte lane, so a byte counter takes at most 2 per round
+        for(size_t round = 0; round < 127 && i + 32 <= n; round++, i += 32) {
+            __m128i lo, hi;
+            kernel_unpack_nibbles(_mm_loadu_si128((const __m128i*)(packed + i / 2)), &lo, &hi);
+            for(uint32_t f = 1; f <= sides; f++) {
+                __m128i face = _mm_set1_epi8((char)f);
+                acc[f] = _mm_sub_epi8(acc[f], _mm_cmpeq_epi8(lo, face));
+                acc[f] = _mm_sub_epi8(acc[f], _mm_cmpeq_epi8(hi, face));
+            }
+        }
+
+        for(uint32_t f = 1; f <= sides; f++) counts[f] += kernel_hsum_u8(acc[f]);
+    }
+#endif
+
+    for(; i < n; i++) {
+        uint32_t value = nibble_get(packed, i);
+        if(value <= sides) counts[value]++;
+    }
+}
+
+uint64_t kernel_count_at_least_nibble(const uint8_t *packed, size_t n, uint32_t threshold) {
+    if(threshold == 0) return n;
+
+    uint64_t total = 0;
+    size_t i = 0;
+
+#ifdef KERNELS_SSE2
+    // Nibbles are 0..15 so the signed byte compare is fine
+    __m128i below = _mm_set1_epi8((char)(threshold > 16 ? 16 : threshold - 1));
+    while(i + 32 <= n) {
+        __m128i acc = _mm_setzero_si128();
+        for(size_t round = 0; round < 127 && i + 32 <= n; round++, i += 32) {
+            __m128i lo, hi;
+            kernel_unpack_nibbles(_mm_loadu_si128((const __m128i*)(packed + i / 2)), &lo, &hi);
+            acc = _mm_sub_epi8(acc, _mm_cmpgt_epi8(lo, below));
+            acc = _mm_sub_epi8(acc, _mm_cmpgt_epi8(hi, below));
+        }
+        total += kernel_hsum_u8(acc);
+    }
+#endif
+
+    for(; i < n; i++) total += nibble_get(packed, i) >= threshold;
+
+    return total;
+}
+
+// The base-6 kernels only run SIMD over whole words, the dice of a partially filled
+// last word are taken one by one since its unused digits would read as ones.
+
+uint64_t kernel_sum_base6(const uint16_t *packed, size_t n) {
+    uint64_t digit_total = 0;
+    size_t i = 0;
+
+#ifdef KERNELS_SSE2
+    const size_t dice_per_vector = 8 * BASE6_DICE_PER_WORD;
+    while(i + dice_per_vector <= n) {
+        // Each round adds at most 6 * 5 to a 16 bit lane
+        __m128i acc = _mm_setzero_si128();
+        for(size_t round = 0; round < 2000 && i + dice_per_vector <= n; round++, i += dice_per_vector) {
+            __m128i digits[BASE6_DICE_PER_WORD];
+            kernel_unpack_base6(_mm_loadu_si128((const __m128i*)(packed + i / BASE6_DICE_PER_WORD)), digits);
+            for(size_t k = 0; k < BASE6_DICE_PER_WORD; k++) acc = _mm_add_epi16(acc, digits[k]);
+        }
+        digit_total += kernel_hsum_u16(acc);
+    }
+#endif
+
+    // Digits are value - 1
+    uint64_t total = digit_total + i;
+    for(; i < n; i++) total += base6_get(packed, i);
+
+    return total;
+}
+
+void kernel_face_counts_base6(const uint16_t *packed, size_t n, uint64_t *counts) {
+    size_t i = 0;
+
+#ifdef KERNELS_SSE2
+    const size_t dice_per_vector = 8 * BASE6_DICE_PER_WORD;
+    while(i + dice_per_vector <= n) {
+        __m128i acc[6];
+        for(size_t f = 0; f < 6; f++) acc[f] = _mm_setzero_si128();
+
+        for(size_t round = 0; round < 10000 && i + dice_per_vector <= n; round++, i += dice_per_vector) {
+            __m128i digits[BASE6_DICE_PER_WORD];
+            kernel_unpack_base6(_mm_loadu_si128((const __m128i*)(packed + i / BASE6_DICE_PER_WORD)), digits);
+            for(size_t f = 0; f < 6; f++) {
+                __m128i face = _mm_set1_epi16((short)f);
+                for(size_t k = 0; k < BASE6_DICE_PER_WORD; k++)
+                    acc[f] = _mm_sub_epi16(acc[f], _mm_cmpeq_epi16(digits[k], face));
+            }
+        }
+
+        for(size_t f = 0; f < 6; f++) counts[f + 1] += kernel_hsum_u16(acc[f]);
+    }
+#endif
+
+    for(; i < n; i++) counts[base6_get(packed, i)]++;
+}
+
+uint64_t kernel_count_at_least_base6(const uint16_t *packed, size_t n, uint32_t threshold) {
+    if(threshold <= 1) return n;
+    if(threshold > 6)  return 0;
+
+    uint64_t total = 0;
+    size_t i = 0;
+
+#ifdef KERNELS_SSE2
+    const size_t dice_per_vector = 8 * BASE6_DICE_PER_WORD;
+    __m128i below = _mm_set1_epi16((short)(threshold - 2));
+    while(i + dice_per_vector <= n) {
+        __m128i acc = _mm_setzero_si128();
+        for(size_t round = 0; round < 10000 && i + dice_per_vector <= n; round++, i += dice_per_vector) {
+            __m128i digits[BASE6_DICE_PER_WORD];
+            kernel_unpack_base6(_mm_loadu_si128((const __m128i*)(packed + i / BASE6_DICE_PER_WORD)), digits);
+            for(size_t k = 0; k < BASE6_DICE_PER_WORD; k++)
+                acc = _mm_sub_epi16(acc, _mm_cmpgt_epi16(digits[k], below));
+        }
+        total += kernel_hsum_u16(acc);
+    }
+#endif
+
+    for(; i < n; i++) total += base6_get(packed, i) >= threshold;
+
+    return total;
+}
+
+#endif // KERNELS_IMPLEMENTATION
@@ -0,0 +1,755 @@
+#ifndef MACRO_H
+#define MACRO_H
+
+// Table of named macros, a zeroed MacroTable is an empty one.
+//
+// Macros live in slots that are reused after a delete, and are referred to by handles
+// of slot and generation, so a handle to a deleted macro stops resolving instead of
+// pointing at whatever took its slot. Live slots are chained in the order they were
+// added, which is the order they are listed in, so deleting never shifts anything.
+//
+// Names are found through an open addressing hash index with linear probing. Deletes
+// shift the entries after them back instead of leaving tombstones, so lookups stay
+// short however many macros come and go. Names and roll texts are copied into an
+// arena of big blocks instead of one allocation each. Deleted ones are left where they
+// are until they make up half of the arena, then the next add copies the live ones
+// into fresh blocks and gives the old ones back.
+//
+// Tables are saved in a binary file that holds the compiled code as it is in memory,
+// plus the names, texts and a copy of the hash index. MacroLibrary maps such a file
+// and reads macros straight out of it, so opening a library of any size costs a
+// bounds check per macro and nothing gets parsed. The file records the sizes of the
+// structs it was written with and is refused by a build that lays them out
+// differently.
+//
+// There is also a text format for editing by hand, one `name: roll` per line. The roll
+// never contains a ':', so names may. It is read in big chunks and compiled line by
+// line without ever holding the whole file.
+//
+// #define MACRO_IMPLEMENTATION in exactly one file before including this, expr.h has to
+// be included first.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define MACRO_NONE        UINT32_MAX
+#define MACRO_ARENA_BLOCK (64 * 1024)
+
+typedef struct Macro {
+    const char *name;       // in the table's arena
+    const char *text;
+    Expr        expr;       // compiled once when the macro is made
+    DiceDist    dist;       // results, only there when has_dist is set
+    bool        has_dist;
+    bool        dist_checked;    // expr_distribution ran, worked out or not
+    bool        dist_estimated;  // dist is or is being sampled because there was no exact one
+    bool        estimate_failed; // sampling did not work out either, it is not tried again
+
+    bool        used;
+    uint32_t    generation; // bumped every time the slot is freed
+    uint32_t    prev;       // neighbours in the order macros were added
+    uint32_t    next;       // doubles as the free list for unused slots
+} Macro;
+
+typedef struct MacroHandle {
+    uint32_t slot;
+    uint32_t generation;
+} MacroHandle;
+
+typedef struct MacroIndexEntry {
+    uint32_t hash;
+    uint32_t slot; // MACRO_NONE when empty
+} MacroIndexEntry;
+
+typedef struct MacroArenaBlock {
+    struct MacroArenaBlock *previous;
+    size_t                  used;
+    size_t                  size;
+    char                    data[];
+} MacroArenaBlock;
+
+typedef struct MacroTable {
+    Macro           *slots;
+    size_t           slot_count;
+    size_t           slot_capacity;
+    uint32_t         free_slot; // first unused slot below slot_count, when free_count > 0
+    size_t           free_count;
+    uint32_t         first;     // both only mean something when count > 0
+    uint32_t         last;
+    size_t           count;
+
+    MacroIndexEntry *index;
+    size_t           index_capacity; // power of two
+
+    MacroArenaBlock *arena;
+    size_t           arena_used; // bytes copied into it so far
+    size_t           arena_dead; // of those, the ones of deleted macros
+} MacroTable;
+
+// Takes over expr. Fails when a macro with that name already exists, expr is left to
+// the caller then.
+bool   macro_table_add(MacroTable *table, const char *name, const char *text, Expr *expr, MacroHandle *handle);
+bool   macro_table_find(const MacroTable *table, const char *name, MacroHandle *handle);
+// NULL once the macro is deleted. The pointer, and its name and text, are good until
+// the next add.
+Macro *macro_table_get(const MacroTable *table, MacroHandle handle);
+bool   macro_table_remove(MacroTable *table, MacroHandle handle);
+void   macro_table_free(MacroTable *table);
+
+// Walks the macros in the order they were added, false past the last one
+bool   macro_table_first(const MacroTable *table, MacroHandle *handle);
+bool   macro_table_next(const MacroTable *table, MacroHandle *handle);
+
+#define MACRO_FILE_MAGIC   0x43414d44 // "DMAC"
+#define MACRO_FILE_VERSION 1
+#define MACRO_MAX_LINE     4096
+
+// Every section starts at a multiple of 8 bytes
+typedef struct MacroFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t op_size;        // sizeof(ExprOp) and sizeof(ExprDice) of the build that wrote it
+    uint32_t dice_size;
+    uint64_t size;           // of the whole file
+    uint64_t macro_count;
+    uint64_t index_capacity; // power of two
+    uint64_t op_count;       // over all macros
+    uint64_t dice_count;
+    uint64_t constant_count;
+    uint64_t string_size;
+    uint64_t records;        // file offsets of the sections
+    uint64_t index;
+    uint64_t ops;
+    uint64_t dice;
+    uint64_t constants;
+    uint64_t strings;
+} MacroFileHeader;
+
+// Where one macro's pieces are within their sections, names and texts end in a 0
+typedef struct MacroFileRecord {
+    uint64_t name;
+    uint64_t text;
+    uint64_t op_start;
+    uint64_t dice_start;
+    uint64_t constant_start;
+    uint32_t op_count;
+    uint32_t dice_count;
+    uint32_t constant_count;
+    uint32_t unused;
+} MacroFileRecord;
+
+typedef struct MacroLibrary {
+    const uint8_t         *data;
+    size_t                 size;
+    const MacroFileHeader *header;
+    const MacroFileRecord *records;
+    const MacroIndexEntry *index;
+    const char            *strings;
+} MacroLibrary;
+
+typedef struct MacroFileReport {
+    size_t added;
+    size_t duplicates;         // names the table already had, those macros are left alone
+    size_t invalid;            // lines or records that did not make a macro
+    size_t first_invalid_line; // counting from 1, 0 when there were none
+} MacroFileReport;
+
+bool   macro_library_open(MacroLibrary *library, const char *path);
+void   macro_library_close(MacroLibrary *library);
+bool   macro_library_find(const MacroLibrary *library, const char *name, size_t *record);
+const char *macro_library_name(const MacroLibrary *library, size_t record);
+const char *macro_library_text(const MacroLibrary *library, size_t record);
+// Points expr into the mapping, so it must never be freed or changed and dies with
+// the library. False when the stored code does not pass expr_check.
+bool   macro_library_expr(const MacroLibrary *library, size_t record, Expr *expr);
+
+// Both add to what the table already has, report may be NULL
+bool   macro_table_save(const MacroTable *table, const char *path);
+bool   macro_table_load(MacroTable *table, const char *path, MacroFileReport *report);
+bool   macro_table_export(const MacroTable *table, const char *path);
+bool   macro_table_import(MacroTable *table, const char *path, MacroFileReport *report);
+
+#endif // MACRO_H
+
+#ifdef MACRO_IMPLEMENTATION
+#undef MACRO_IMPLEMENTATION
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static uint32_t macro_hash(const char *name) {
+    uint32_t hash = 2166136261u;
+    for(const unsigned char *c = (const unsigned char *)name; *c != '\0'; c++) {
+        hash ^= *c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static const char *macro_arena_copy(MacroTable *table, const char *text) {
+    size_t size = strlen(text) + 1;
+
+    MacroArenaBlock *block = table->arena;
+    if(block == NULL || block->size - block->used < size) {
+        size_t block_size = size > MACRO_ARENA_BLOCK ? size : MACRO_ARENA_BLOCK;
+        block = malloc(sizeof(*block) + block_size);
+        block->previous = table->arena;
+        block->used     = 0;
+        block->size     = block_size;
+        table->arena    = block;
+    }
+
+    char *copy = block->data + block->used;
+    memcpy(copy, text, size);
+    block->used       += size;
+    table->arena_used += size;
+    return copy;
+}
+
+// Copies the names and texts of the live macros into fresh blocks and frees the old ones
+static void macro_arena_compact(MacroTable *table) {
+    MacroArenaBlock *old = table->arena;
+    table->arena      = NULL;
+    table->arena_used = 0;
+    table->arena_dead = 0;
+
+    for(size_t i = 0; i < table->slot_count; i++) {
+        Macro *macro = &table->slots[i];
+        if(!macro->used) continue;
+        macro->name = macro_arena_copy(table, macro->name);
+        macro->text = macro_arena_copy(table, macro->text);
+    }
+
+    while(old != NULL) {
+        MacroArenaBlock *previous = old->previous;
+        free(old);
+        old = previous;
+    }
+}
+
+// Index slot holding name, or the empty one it would go in
+static size_t macro_index_probe(const MacroTable *table, const char *name, uint32_t hash) {
+    size_t mask = table->index_capacity - 1;
+    size_t at   = hash & mask;
+
+    while(table->index[at].slot != MACRO_NONE) {
+        const MacroIndexEntry *entry = &table->index[at];
+        if(entry->hash == hash && strcmp(table->slots[entry->slot].name, name) == 0) break;
+        at = (at + 1) & mask;
+    }
+    return at;
+}
+
+static void macro_index_grow(MacroTable *table) {
+    MacroIndexEntry *old          = table->index;
+    size_t           old_capacity = table->index_capacity;
+
+    table->index_capacity = old_capacity == 0 ? 64 : old_capacity * 2;
+    table->index          = malloc(table->index_capacity * sizeof(*table->index));
+    for(size_t i = 0; i < table->index_capacity; i++) table->index[i].slot = MACRO_NONE;
+
+    for(size_t i = 0; i < old_capacity; i++) {
+        if(old[i].slot == MACRO_NONE) continue;
+        size_t at = old[i].hash & (table->index_capacity - 1);
+        while(table->index[at].slot != MACRO_NONE) at = (at + 1) & (table->index_capacity - 1);
+        table->index[at] = old[i];
+    }
+
+    free(old);
+}
+
+bool macro_table_find(const MacroTable *table, const char *name, MacroHandle *handle) {
+    if(table->count == 0) return false;
+
+    size_t at = macro_index_probe(table, name, macro_hash(name));
+    if(table->index[at].slot == MACRO_NONE) return false;
+
+    uint32_t slot = table->index[at].slot;
+    if(handle != NULL) *handle = (MacroHandle){ .slot = slot, .generation = table->slots[slot].generation };
+    return true;
+}
+
+bool macro_table_add(MacroTable *table, const char *name, const char *text, Expr *expr, MacroHandle *handle) {
+    // Kept at most half full so probes stay short
+    if((table->count + 1) * 2 > table->index_capacity) macro_index_grow(table);
+
+    uint32_t hash = macro_hash(name);
+    size_t   at   = macro_index_probe(table, name, hash);
+    if(table->index[at].slot != MACRO_NONE) return false;
+
+    uint32_t slot;
+    if(table->free_count > 0) {
+        slot             = table->free_slot;
+        table->free_slot = table->slots[slot].next;
+        table->free_count--;
+    } else {
+        if(table->slot_count == table->slot_capacity) {
+            table->slot_capacity = table->slot_capacity == 0 ? 16 : table->slot_capacity * 2;
+            table->slots         = realloc(table->slots, table->slot_capacity * sizeof(*table->slots));
+        }
+        slot = (uint32_t)table->slot_count++;
+        table->slots[slot].generation = 0;
+    }
+
+    uint32_t generation = table->slots[slot].generation;
+    Macro   *macro      = &table->slots[slot];
+    *macro = (Macro) {
+        .name       = macro_arena_copy(table, name),
+        .text       = macro_arena_copy(table, text),
+        .expr       = *expr,
+        .used       = true,
+        .generation = generation,
+        .prev       = table->count > 0 ? table->last : MACRO_NONE,
+        .next       = MACRO_NONE,
+    };
+    *expr = (Expr){0};
+
+    if(table->count > 0) table->slots[table->last].next = slot;
+    else                 table->first                   = slot;
+    table->last = slot;
+
+    table->index[at] = (MacroIndexEntry){ .hash = hash, .slot = slot };
+    table->count++;
+
+    // Only after the copies, name and text may well point into the arena themselves
+    if(table->arena_dead >= MACRO_ARENA_BLOCK && table->arena_dead * 2 >= table->arena_used) macro_arena_compact(table);
+
+    if(handle != NULL) *handle = (MacroHandle){ .slot = slot, .generation = macro->generation };
+    return true;
+}
+
+Macro *macro_table_get(const MacroTable *table, MacroHandle handle) {
+    if(handle.slot >= table->slot_count) return NULL;
+
+    Macro *macro = &table->slots[handle.slot];
+    if(!macro->used || macro->generation != handle.generation) return NULL;
+    return macro;
+}
+
+bool macro_table_remove(MacroTable *table, MacroHandle handle) {
+    Macro *macro = macro_table_get(table, handle);
+    if(macro == NULL) return false;
+
+    // Backward shift: entries after the hole that would have probed past it move up
+    size_t mask = table->index_capacity - 1;
+    size_t hole = macro_index_probe(table, macro->name, macro_hash(macro->name));
+    for(size_t at = (hole + 1) & mask; table->index[at].slot != MACRO_NONE; at = (at + 1) & mask) {
+        size_t home = table->index[at].hash & mask;
+        if(((at - home) & mask) >= ((at - hole) & mask)) {
+            table->index[hole] = table->index[at];
+            hole = at;
+        }
+    }
+    table->index[hole].slot = MACRO_NONE;
+
+    if(macro->prev != MACRO_NONE) table->slots[macro->prev].next = macro->next;
+    else                          table->first                   = macro->next;
+    if(macro->next != MACRO_NONE) table->slots[macro->next].prev = macro->prev;
+    else                          table->last                    = macro->prev;
+
+    expr_free(&macro->expr);
+    if(macro->has_dist) dist_free(&macro->dist);
+
+    // Name and text stay in the arena until a later add compacts it
+    table->arena_dead += strlen(macro->name) + 1 + strlen(macro->text) + 1;
+    macro->used     = false;
+    macro->has_dist = false;
+    macro->generation++;
+    macro->next      = table->free_slot;
+    table->free_slot = handle.slot;
+    table->free_count++;
+    table->count--;
+
+    return true;
+}
+
+bool macro_table_first(const MacroTable *table, MacroHandle *handle) {
+    if(table->count == 0) return false;
+    *handle = (MacroHandle){ .slot = table->first, .generation = table->slots[table->first].generation };
+    return true;
+}
+
+bool macro_table_next(const MacroTable *table, MacroHandle *handle) {
+    uint32_t next = table->slots[handle->slot].next;
+    if(next == MACRO_NONE) return false;
+    *handle = (MacroHandle){ .slot = next, .generation = table->slots[next].generation };
+    return true;
+}
+
+void macro_table_free(MacroTable *table) {
+    for(size_t i = 0; i < table->slot_count; i++) {
+        if(!table->slots[i].used) continue;
+        expr_free(&table->slots[i].expr);
+        if(table->slots[i].has_dist) dist_free(&table->slots[i].dist);
+    }
+
+    while(table->arena != NULL) {
+        MacroArenaBlock *previous = table->arena->previous;
+        free(table->arena);
+        table->arena = previous;
+    }
+
+    free(table->slots);
+    free(table->index);
+    *table = (MacroTable){0};
+}
+
+static size_t macro_align(size_t offset) {
+    return (offset + 7) & ~(size_t)7;
+}
+
+static bool macro_write(FILE *file, const void *data, size_t size) {
+    return size == 0 || fwrite(data, 1, size, file) == size;
+}
+
+static bool macro_write_at(FILE *file, size_t *offset, size_t at, const void *data, size_t size) {
+    static const uint8_t zeros[8] = {0};
+    if(!macro_write(file, zeros, at - *offset) || !macro_write(file, data, size)) return false;
+    *offset = at + size;
+    return true;
+}
+
+bool macro_table_save(const MacroTable *table, const char *path) {
+    MacroFileHeader header = {
+        .magic          = MACRO_FILE_MAGIC,
+        .version        = MACRO_FILE_VERSION,
+        .op_size        = sizeof(ExprOp),
+        .dice_size      = sizeof(ExprDice),
+        .macro_count    = table->count,
+        .index_capacity = 16,
+    };
+    while(header.index_capacity < 2 * header.macro_count) header.index_capacity *= 2;
+
+    MacroFileRecord *records = calloc(table->count + 1, sizeof(*records));
+    MacroIndexEntry *index   = malloc(header.index_capacity * sizeof(*index));
+    for(size_t i = 0; i < header.index_capacity; i++) index[i].slot = MACRO_NONE;
+
+    // Records and index first, they say where everything else goes
+    MacroHandle handle;
+    size_t      record = 0;
+    for(bool more = macro_table_first(table, &handle); more; more = macro_table_next(table, &handle), record++) {
+        const Macro *macro = &table->slots[handle.slot];
+        records[record] = (MacroFileRecord) {
+            .name           = header.string_size,
+            .text           = header.string_size + strlen(macro->name) + 1,
+            .op_start       = header.op_count,
+            .dice_start     = header.dice_count,
+            .constant_start = header.constant_count,
+            .op_count       = (uint32_t)macro->expr.op_count,
+            .dice_count     = (uint32_t)macro->expr.dice_count,
+            .constant_count = (uint32_t)macro->expr.constant_count,
+        };
+        header.string_size    += strlen(macro->name) + 1 + strlen(macro->text) + 1;
+        header.op_count       += macro->expr.op_count;
+        header.dice_count     += macro->expr.dice_count;
+        header.constant_count += macro->expr.constant_count;
+
+        uint32_t hash = macro_hash(macro->name);
+        size_t   at   = hash & (header.index_capacity - 1);
+        while(index[at].slot != MACRO_NONE) at = (at + 1) & (header.index_capacity - 1);
+        index[at] = (MacroIndexEntry){ .hash = hash, .slot = (uint32_t)record };
+    }
+
+    header.records   = macro_align(sizeof(header));
+    header.index     = macro_align(header.records   + header.macro_count    * sizeof(MacroFileRecord));
+    header.ops       = macro_align(header.index     + header.index_capacity * sizeof(MacroIndexEntry));
+    header.dice      = macro_align(header.ops       + header.op_count       * sizeof(ExprOp));
+    header.constants = macro_align(header.dice      + header.dice_count     * sizeof(ExprDice));
+    header.strings   = macro_align(header.constants + header.constant_count * sizeof(int64_t));
+    header.size      = header.strings + header.string_size;
+
+    // Written next to the old file and moved over it, so a failed save leaves that alone
+    size_t temporary_size = strlen(path) + 5;
+    char  *temporary      = malloc(temporary_size);
+    snprintf(temporary, temporary_size, "%s.tmp", path);
+
+    FILE  *file   = fopen(temporary, "wb");
+    size_t offset = 0;
+    bool   ok     = file != NULL;
+
+    ok = ok && macro_write_at(file, &offset, 0,              &header, sizeof(header));
+    ok = ok && macro_write_at(file, &offset, header.records, records, header.macro_count    * sizeof(*records));
+    ok = ok && macro_write_at(file, &offset, header.index,   index,   header.index_capacity * sizeof(*index));
+
+    // The remaining sections are each macro's arrays back to back
+    size_t section_starts[] = { header.ops, header.dice, header.constants, header.strings };
+    for(size_t section = 0; section < 4 && ok; section++) {
+        ok = macro_write_at(file, &offset, section_starts[section], NULL, 0);
+
+        for(bool more = macro_table_first(table, &handle); more && ok; more = macro_table_next(table, &handle)) {
+            const Macro *macro = &table->slots[handle.slot];
+            switch(section) {
+                case 0:  ok = macro_write(file, macro->expr.ops,       macro->expr.op_count       * sizeof(ExprOp));   break;
+                case 1:  ok = macro_write(file, macro->expr.dice,      macro->expr.dice_count     * sizeof(ExprDice)); break;
+                case 2:  ok = macro_write(file, macro->expr.constants, macro->expr.constant_count * sizeof(int64_t));  break;
+                default: ok = macro_write(file, macro->name, strlen(macro->name) + 1)
+                           && macro_write(file, macro->text, strlen(macro->text) + 1);                                break;
+            }
+        }
+
+        size_t sizes[] = { sizeof(ExprOp) * header.op_count, sizeof(ExprDice) * header.dice_count,
+                           sizeof(int64_t) * header.constant_count, header.string_size };
+        offset += sizes[section];
+    }
+
+    if(file != NULL && fclose(file) != 0) ok = false;
+    if(ok) ok = rename(temporary, path) == 0;
+    if(!ok) remove(temporary);
+
+    free(temporary);
+    free(index);
+    free(records);
+    return ok;
+}
+
+static bool macro_section_fits(uint64_t file_size, uint64_t offset, uint64_t count, uint64_t size) {
+    return offset % 8 == 0 && offset <= file_size && count <= (file_size - offset) / size;
+}
+
+static bool macro_string_fits(const MacroLibrary *library, uint64_t offset) {
+    uint64_t size = library->header->string_size;
+    return offset < size && memchr(library->strings + offset, '\0', size - offset) != NULL;
+}
+
+bool macro_library_open(MacroLibrary *library, const char *path) {
+    *library = (MacroLibrary){0};
+
+    int file = open(path, O_RDONLY);
+    if(file < 0) return false;
+
+    struct stat info;
+    if(fstat(file, &info) != 0 || (size_t)info.st_size < sizeof(MacroFileHeader)) {
+        close(file);
+        return false;
+    }
+
+    void *data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if(data == MAP_FAILED) return false;
+
+    library->data    = data;
+    library->size    = (size_t)info.st_size;
+    library->header  = data;
+
+    const MacroFileHeader *header = library->header;
+    bool valid = header->magic == MACRO_FILE_MAGIC && header->version == MACRO_FILE_VERSION
+              && header->op_size == sizeof(ExprOp) && header->dice_size == sizeof(ExprDice)
+              && header->size == library->size
+              && header->index_capacity >= header->macro_count && header->index_capacity > 0
+              && (header->index_capacity & (header->index_capacity - 1)) == 0
+              && macro_section_fits(header->size, header->records,   header->macro_count,    sizeof(MacroFileRecord))
+              && macro_section_fits(header->size, header->index,     header->index_capacity, sizeof(MacroIndexEntry))
+              && macro_section_fits(header->size, header->ops,       header->op_count,       sizeof(ExprOp))
+              && macro_section_fits(header->size, header->dice,      header->dice_count,     sizeof(ExprDice))
+              && macro_section_fits(header->size, header->constants, header->constant_count, sizeof(int64_t))
+              && macro_section_fits(header->size, header->strings,   header->string_size,    1);
+
+    if(valid) {
+        library->records = (const MacroFileRecord *)(library->data + header->records);
+        library->index   = (const MacroIndexEntry *)(library->data + header->index);
+        library->strings = (const char *)(library->data + header->strings);
+    }
+
+    // Everything a record points at has to be in the file, whether the code in there
+    // makes sense is only checked once it gets used
+    for(uint64_t i = 0; i < header->macro_count && valid; i++) {
+        const MacroFileRecord *record = &library->records[i];
+        valid = macro_string_fits(library, record->name) && macro_string_fits(library, record->text)
+             && record->op_start       <= header->op_count       && record->op_count       <= header->op_count       - record->op_start
+             && record->dice_start     <= header->dice_count     && record->dice_count     <= header->dice_count     - record->dice_start
+             && record->constant_start <= header->constant_count && record->constant_count <= header->constant_count - record->constant_start;
+    }
+
+    if(!valid) macro_library_close(library);
+    return valid;
+}
+
+void macro_library_close(MacroLibrary *library) {
+    if(library->data != NULL) munmap((void *)library->data, library->size);
+    *library = (MacroLibrary){0};
+}
+
+const char *macro_library_name(const MacroLibrary *library, size_t record) {
+    return library->strings + library->records[record].name;
+}
+
+const char *macro_library_text(const MacroLibrary *library, size_t record) {
+    return library->strings + library->records[record].text;
+}
+
+bool macro_library_find(const MacroLibrary *library, const char *name, size_t *record) {
+    uint32_t hash = macro_hash(name);
+    size_t   mask = library->header->index_capacity - 1;
+
+    // Bounded by the capacity, the index in the file could be full
+    for(size_t probe = 0, at = hash & mask; probe <= mask; probe++, at = (at + 1) & mask) {
+        MacroIndexEntry entry = library->index[at];
+        if(entry.slot == MACRO_NONE || entry.slot >= library->header->macro_count) return false;
+
+        if(entry.hash == hash && strcmp(macro_library_name(library, entry.slot), name) == 0) {
+            if(record != NULL) *record = entry.slot;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool macro_library_expr(const MacroLibrary *library, size_t record, Expr *expr) {
+    const MacroFileRecord *at     = &library->records[record];
+    const MacroFileHeader *header = library->header;
+
+    *expr = (Expr) {
+        .ops            = (ExprOp *)(library->data + header->ops) + at->op_start,
+        .op_count       = at->op_count,
+        .dice           = (ExprDice *)(library->data + header->dice) + at->dice_start,
+        .dice_count     = at->dice_count,
+        .constants      = (int64_t *)(library->data + header->constants) + at->constant_start,
+        .constant_count = at->constant_count,
+    };
+    return expr_check(expr);
+}
+
+static void macro_report_invalid(MacroFileReport *report, size_t line) {
+    if(report->first_invalid_line == 0) report->first_invalid_line = line;
+    report->invalid++;
+}
+
+bool macro_table_load(MacroTable *table, const char *path, MacroFileReport *report) {
+    MacroFileReport ignored;
+    if(report == NULL) report = &ignored;
+    *report = (MacroFileReport){0};
+
+    MacroLibrary library;
+    if(!macro_library_open(&library, path)) return false;
+
+    for(size_t i = 0; i < library.header->macro_count; i++) {
+        Expr stored, expr;
+        if(!macro_library_expr(&library, i, &stored)) {
+            macro_report_invalid(report, i + 1);
+            continue;
+        }
+
+        expr_copy(&expr, &stored);
+        if(macro_table_add(table, macro_library_name(&library, i), macro_library_text(&library, i), &expr, NULL)) {
+            report->added++;
+        } else {
+            report->duplicates++;
+            expr_free(&expr);
+        }
+    }
+
+    macro_library_close(&library);
+    return true;
+}
+
+bool macro_table_export(const MacroTable *table, const char *path) {
+    FILE *file = fopen(path, "wb");
+    if(file == NULL) return false;
+
+    bool        ok = true;
+    MacroHandle handle;
+    for(bool more = macro_table_first(table, &handle); more && ok; more = macro_table_next(table, &handle)) {
+        const Macro *macro = &table->slots[handle.slot];
+        ok = fprintf(file, "%s: %s\n", macro->name, macro->text) > 0;
+    }
+
+    if(fclose(file) != 0) ok = false;
+    return ok;
+}
+
+static char *macro_trim(char *text, char *end) {
+    while(text < end && (*text == ' ' || *text == '\t')) text++;
+    while(end > text && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) end--;
+    *end = '\0';
+    return text;
+}
+
+static void macro_import_line(MacroTable *table, char *line, size_t length, size_t number, MacroFileReport *report) {
+    char *text = macro_trim(line, line + length);
+    if(*text == '\0') return;
+
+    char *colon = strrchr(text, ':');
+    if(colon == NULL) {
+        macro_report_invalid(report, number);
+        return;
+    }
+
+    char *name = macro_trim(text, colon);
+    char *roll = macro_trim(colon + 1, colon + 1 + strlen(colon + 1));
+
+    Expr expr;
+    if(*name == '\0' || !expr_compile(&expr, roll, NULL)) {
+        macro_report_invalid(report, number);
+        return;
+    }
+
+    if(macro_table_add(table, name, roll, &expr, NULL)) {
+        report->added++;
+    } else {
+        report->duplicates++;
+        expr_free(&expr);
+    }
+}
+
+bool macro_table_import(MacroTable *table, const char *path, MacroFileReport *report) {
+    MacroFileReport ignored;
+    if(report == NULL) report = &ignored;
+    *report = (MacroFileReport){0};
+
+    FILE *file = fopen(path, "rb");
+    if(file == NULL) return false;
+
+    static char chunk[64 * 1024];
+    char   line[MACRO_MAX_LINE];
+    size_t line_length = 0;
+    size_t number      = 1;
+    bool   too_long    = false;
+    size_t read;
+
+    // Lines are cut out of the chunk in place, only one that runs over the end of a
+    // chunk gets copied into line to be finished with the next one
+    while((read = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        char *at  = chunk;
+        char *end = chunk + read;
+
+        while(at < end) {
+            char  *newline = memchr(at, '\n', (size_t)(end - at));
+            char  *stop    = newline != NULL ? newline : end;
+            size_t length  = (size_t)(stop - at);
+
+            if(too_long || line_length + length >= sizeof(line)) {
+                too_long = true;
+            } else if(line_length == 0 && newline != NULL) {
+                *newline = '\0';
+                macro_import_line(table, at, length, number, report);
+            } else {
+                memcpy(line + line_length, at, length);
+                line_length += length;
+                if(newline != NULL) macro_import_line(table, line, line_length, number, report);
+            }
+
+            if(newline == NULL) break;
+
+            if(too_long) macro_report_invalid(report, number);
+            too_long    = false;
+            line_length = 0;
+            number++;
+            at = newline + 1;
+        }
+    }
+
+    if(too_long)             macro_report_invalid(report, number);
+    else if(line_length > 0) macro_import_line(table, line, line_length, number, report);
+
+    bool ok = !ferror(file);
+    fclose(file);
+    return ok;
+}
+
+#endif // MACRO_IMPLEMENTATION
@@ -0,0 +1,353 @@
+#ifndef MONTECARLO_H
+#define MONTECARLO_H
+
+// Monte Carlo estimates of what a compiled roll comes out as, for the expressions
+// expr_distribution gives up on.
+//
+// Samples are drawn in blocks of MC_BLOCK rolls, block i always from the generator
+// jumped i times. Threads claim blocks off an atomic counter and count what they
+// roll into a histogram of their own, so the only shared write is the claim, once
+// per block. The histograms are added up when a round is over. Adding counts does
+// not care about order, so which thread got which block never shows in the result.
+// Rounds are sized to keep every thread busy, which makes the result depend on the
+// seed and the thread count.
+//
+// The run goes in rounds. After each one the confidence intervals of the mean and of
+// every P(result >= x) are compared to the widths asked for. Widths shrink with the
+// square root of the sample count, so the next round is sized from how far off they
+// still are instead of creeping up on them.
+//
+// #define MC_IMPLEMENTATION in exactly one file before including this, rng.h,
+// kernels.h, dist.h and expr.h have to be included first.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define MC_BLOCK       16384
+#define MC_MAX_SAMPLES (1ull << 32)
+// Histograms are refused past this many distinct results from lowest to highest
+#define MC_MAX_SPAN    (1 << 22)
+
+typedef struct McConfig {
+    uint64_t seed;
+    size_t   threads;           // 0 for one per core
+    double   confidence;        // of the intervals, 0.95 when 0
+    double   mean_width;        // stop once the mean's interval is at most this wide, 0 to not care
+    double   probability_width; // same for the widest interval of any P(result >= x)
+    uint64_t max_samples;       // stop here even when the widths were not reached, MC_MAX_SAMPLES when 0,
+                                // rounded up to whole blocks
+} McConfig;
+
+typedef struct McResult {
+    uint64_t samples;
+    size_t   threads;
+    size_t   rounds;
+    double   seconds;
+    double   samples_per_second;
+    double   mean;
+    double   mean_width;        // what the intervals came out as
+    double   probability_width;
+    bool     converged;         // reached the widths asked for before max_samples
+    DiceDist dist;              // how often each result came up, free with dist_free
+} McResult;
+
+// On failure error, when not NULL, says why
+bool mc_run(const Expr *expr, const McConfig *config, McResult *result, const char **error);
+
+// Counts of results from min on, grown on either side as results turn up. A zeroed
+// one is empty.
+typedef struct McHistogram {
+    int64_t   min;
+    uint64_t *counts;
+    size_t    count;
+} McHistogram;
+
+// Both false when the results would span more than MC_MAX_SPAN values
+bool mc_histogram_add(McHistogram *histogram, int64_t value);
+bool mc_histogram_merge(McHistogram *into, const McHistogram *from);
+void mc_histogram_free(McHistogram *histogram);
+
+#endif // MONTECARLO_H
+
+#ifdef MC_IMPLEMENTATION
+#undef MC_IMPLEMENTATION
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define MC_MAX_THREADS 256
+
+typedef struct McRound {
+    const Expr    *expr;
+    const Rng     *streams;     // one per block
+    size_t         block_count;
+    atomic_size_t  next_block;
+    atomic_bool    failed;      // a result landed too far out for a histogram
+} McRound;
+
+typedef struct McWorker {
+    McRound     *round;
+    McHistogram  histogram;     // kept from round to round
+    pthread_t    thread;
+} McWorker;
+
+static double mc_now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec + (double)time.tv_nsec * 1e-9;
+}
+
+// Makes room for value, false when that would span more than MC_MAX_SPAN results
+static bool mc_histogram_reach(McHistogram *histogram, int64_t value) {
+    if(histogram->count == 0) {
+        histogram->min    = value;
+        histogram->count  = 1;
+        histogram->counts = calloc(1, sizeof(uint64_t));
+        return true;
+    }
+
+    int64_t low  = value < histogram->min ? value : histogram->min;
+    int64_t high = histogram->min + (int64_t)histogram->count - 1;
+    if(value > high) high = value;
+    if((uint64_t)high - (uint64_t)low >= MC_MAX_SPAN) return false;
+
+    // At least double, so a slowly widening tail does not copy on every new result
+    size_t count = (size_t)(high - low) + 1;
+    size_t grown = histogram->count * 2 < MC_MAX_SPAN ? histogram->count * 2 : MC_MAX_SPAN;
+    if(count < grown) {
+        if(value < histogram->min) low = high - (int64_t)grown + 1;
+        count = grown;
+    }
+
+    uint64_t *counts = calloc(count, sizeof(uint64_t));
+    memcpy(counts + (histogram->min - low), histogram->counts, histogram->count * sizeof(uint64_t));
+    free(histogram->counts);
+
+    histogram->min    = low;
+    histogram->counts = counts;
+    histogram->count  = count;
+    return true;
+}
+
+bool mc_histogram_add(McHistogram *histogram, int64_t value) {
+    uint64_t at = (uint64_t)value - (uint64_t)histogram->min;
+    if(at >= histogram->count) {
+        if(!mc_histogram_reach(histogram, value)) return false;
+        at = (uint64_t)value - (uint64_t)histogram->min;
+    }
+    histogram->counts[at]++;
+    return true;
+}
+
+bool mc_histogram_merge(McHistogram *into, const McHistogram *from) {
+    if(from->count == 0) return true;
+
+    int64_t ends[2] = { from->min, from->min + (int64_t)from->count - 1 };
+    for(int e = 0; e < 2; e++) {
+        if((uint64_t)ends[e] - (uint64_t)into->min < into->count) continue;
+        if(!mc_histogram_reach(into, ends[e])) return false;
+    }
+
+    uint64_t *counts = into->counts + (from->min - into->min);
+    for(size_t i = 0; i < from->count; i++) counts[i] += from->counts[i];
+    return true;
+}
+
+void mc_histogram_free(McHistogram *histogram) {
+    free(histogram->counts);
+    *histogram = (McHistogram){0};
+}
+
+static void *mc_worker(void *arg) {
+    McWorker    *worker    = arg;
+    McRound     *round     = worker->round;
+    McHistogram *histogram = &worker->histogram;
+
+    int64_t values[1024];
+
+    for(;;) {
+        size_t block = atomic_fetch_add_explicit(&round->next_block, 1, memory_order_relaxed);
+        if(block >= round->block_count) break;
+
+        Rng stream = round->streams[block];
+        for(size_t done = 0; done < MC_BLOCK; done += 1024) {
+            expr_eval_batch(round->expr, &stream, values, 1024);
+
+            for(size_t i = 0; i < 1024; i++) {
+                if(!mc_histogram_add(histogram, values[i])) {
+                    atomic_store(&round->failed, true);
+                    return NULL;
+                }
+            }
+        }
+
+        if(atomic_load_explicit(&round->failed, memory_order_relaxed)) break;
+    }
+
+    return NULL;
+}
+
+// x with P(Z <= x) = p for a standard normal Z, by bisection since it only runs once
+static double mc_normal_quantile(double p) {
+    double low = -10.0, high = 10.0;
+    for(int i = 0; i < 100; i++) {
+        double middle = 0.5 * (low + high);
+        if(0.5 * erfc(-middle / sqrt(2.0)) < p) low  = middle;
+        else                                     high = middle;
+    }
+    return 0.5 * (low + high);
+}
+
+// Mean and interval widths of everything the workers counted so far, false when it
+// spans too much to add up
+static bool mc_measure(const McWorker *workers, size_t threads, double z, McHistogram *total, McResult *result) {
+    mc_histogram_free(total);
+    for(size_t t = 0; t < threads; t++)
+        if(!mc_histogram_merge(total, &workers[t].histogram)) return false;
+
+    // Growing leaves room on the ends that nothing landed in
+    size_t first = 0;
+    while(total->counts[first] == 0) first++;
+    while(total->counts[total->count - 1] == 0) total->count--;
+    memmove(total->counts, total->counts + first, (total->count - first) * sizeof(uint64_t));
+    total->min   += (int64_t)first;
+    total->count -= first;
+    int64_t low   = total->min;
+
+    // Offsets from the lowest result keep the sums small enough for doubles
+    double n = (double)result->samples, sum = 0.0;
+    for(size_t i = 0; i < total->count; i++) sum += (double)total->counts[i] * (double)i;
+    double offset = sum / n;
+
+    double squares = 0.0, widest = 0.0, above = 0.0;
+    for(size_t i = total->count; i-- > 0; ) {
+        double d = (double)i - offset;
+        squares += (double)total->counts[i] * d * d;
+
+        above += (double)total->counts[i];
+        double p = above / n;
+        if(p * (1.0 - p) > widest) widest = p * (1.0 - p);
+    }
+
+    result->mean              = (double)low + offset;
+    result->mean_width        = 2.0 * z * sqrt(squares / (n - 1.0 > 1.0 ? n - 1.0 : 1.0) / n);
+    result->probability_width = 2.0 * z * sqrt(widest / n);
+    return true;
+}
+
+bool mc_run(const Expr *expr, const McConfig *config, McResult *result, const char **error) {
+    const char *ignored;
+    if(error == NULL) error = &ignored;
+    *result = (McResult){0};
+
+    size_t threads = config->threads;
+    if(threads == 0) {
+        long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpu_count > 0 ? (size_t)cpu_count : 1;
+    }
+    if(threads > MC_MAX_THREADS) threads = MC_MAX_THREADS;
+
+    double   confidence  = config->confidence > 0.0 && config->confidence < 1.0 ? config->confidence : 0.95;
+    double   z           = mc_normal_quantile(0.5 + confidence / 2.0);
+    uint64_t max_samples = config->max_samples > 0 ? config->max_samples : MC_MAX_SAMPLES;
+    uint64_t max_blocks  = (max_samples + MC_BLOCK - 1) / MC_BLOCK;
+
+    Rng rng;
+    rng_seed(&rng, config->seed);
+
+    McWorker    *workers = calloc(threads, sizeof(*workers));
+    McHistogram  total   = {0};
+    Rng         *streams = NULL;
+    bool         failed  = false;
+
+    // Enough blocks for every thread to claim a few, so they all finish close together
+    uint64_t blocks = 4 * threads;
+    double   start  = mc_now();
+
+    while(!failed) {
+        uint64_t done = result->samples / MC_BLOCK;
+        if(blocks > max_blocks - done) blocks = max_blocks - done;
+        if(blocks == 0) break;
+
+        streams = realloc(streams, blocks * sizeof(*streams));
+        for(uint64_t b = 0; b < blocks; b++) {
+            streams[b] = rng;
+            rng_jump(&rng);
+        }
+
+        McRound round = { .expr = expr, .streams = streams, .block_count = (size_t)blocks };
+        atomic_init(&round.next_block, 0);
+        atomic_init(&round.failed, false);
+
+        // The calling thread is worker 0, and takes over any worker that could not start
+        bool spawned[MC_MAX_THREADS] = {0};
+        for(size_t t = 0; t < threads; t++) workers[t].round = &round;
+        for(size_t t = 1; t < threads; t++)
+            spawned[t] = pthread_create(&workers[t].thread, NULL, mc_worker, &workers[t]) == 0;
+
+        mc_worker(&workers[0]);
+
+        for(size_t t = 1; t < threads; t++) {
+            if(spawned[t]) pthread_join(workers[t].thread, NULL);
+            else           mc_worker(&workers[t]);
+        }
+
+        if(atomic_load(&round.failed)) {
+            failed = true;
+            break;
+        }
+
+        result->samples += blocks * MC_BLOCK;
+        result->rounds++;
+        if(!mc_measure(workers, threads, z, &total, result)) {
+            failed = true;
+            break;
+        }
+
+        bool mean_done        = config->mean_width        <= 0.0 || result->mean_width        <= config->mean_width;
+        bool probability_done = config->probability_width <= 0.0 || result->probability_width <= config->probability_width;
+        bool asked            = config->mean_width > 0.0 || config->probability_width > 0.0;
+        if(asked && mean_done && probability_done) {
+            result->converged = true;
+            break;
+        }
+
+        // Samples the widths still need, with some to spare since the variance is an
+        // estimate as well, but never more than 8 times what there is already
+        double needed = 1.0;
+        if(config->mean_width > 0.0) {
+            double ratio = result->mean_width / config->mean_width;
+            if(ratio * ratio > needed) needed = ratio * ratio;
+        }
+        if(config->probability_width > 0.0) {
+            double ratio = result->probability_width / config->probability_width;
+            if(ratio * ratio > needed) needed = ratio * ratio;
+        }
+        if(!asked || needed > 8.0) needed = 8.0;
+
+        uint64_t more = (uint64_t)((double)result->samples * (needed * 1.1 - 1.0)) / MC_BLOCK + 1;
+        blocks = more > 4 * threads ? more : 4 * threads;
+    }
+
+    result->seconds            = mc_now() - start;
+    result->threads            = threads;
+    result->samples_per_second = result->seconds > 0.0 ? (double)result->samples / result->seconds : 0.0;
+
+    if(failed)                    *error = "results spread over too many values to count";
+    else if(result->samples == 0) *error = "no samples were asked for";
+    else                          dist_from_counts(&result->dist, total.min, total.counts, total.count);
+
+    for(size_t t = 0; t < threads; t++) mc_histogram_free(&workers[t].histogram);
+    free(workers);
+    free(streams);
+    mc_histogram_free(&total);
+    return !failed && result->samples > 0;
+}
+
+#endif // MC_IMPLEMENTATION
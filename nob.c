@@ -203,14 +203,45 @@ bool append_asset_package_to_end_of_executable(void) {
     return true;
 }
 
+bool build_and_run_bench(int argc, char **argv) {
+
+    const char *bench_files[] = { "bench.c", "rng.h", "kernels.h", "pool.h", "dist.h", "expr.h", "macro.h", "montecarlo.h" };
+
+    if(nob_needs_rebuild("./build/bench", bench_files, NOB_ARRAY_LEN(bench_files))) {
+        Nob_Cmd cmd = {0};
+
+        nob_cmd_append(&cmd,
+            "cc", "-Wall", "-Wextra", "-O2", "-ggdb",
+            "-o", "./build/bench", "bench.c",
+            "-I./" RAYLIB_SOURCE_PATH, "-lm", "-lpthread"
+        );
+
+        if(!nob_cmd_run_sync(cmd)) return false;
+    }
+
+    Nob_Cmd cmd = {0};
+
+    nob_cmd_append(&cmd, "./build/bench");
+    for(int i = 0; i < argc; i++) nob_cmd_append(&cmd, argv[i]);
+
+    return nob_cmd_run_sync(cmd);
+}
+
 int main(int argc, char **argv) {
     NOB_GO_REBUILD_URSELF(argc, argv);
 
+    nob_shift_args(&argc, &argv);
+
     if(!nob_mkdir_if_not_exists("build")) {
         nob_log(NOB_ERROR, "Failed to create build directory");
         return 1;
     }
 
+    if(argc > 0 && strcmp(argv[0], "bench") == 0) {
+        nob_shift_args(&argc, &argv);
+        return build_and_run_bench(argc, argv) ? 0 : 1;
+    }
+
     if(!nob_mkdir_if_not_exists("tools")) {
         nob_log(NOB_ERROR, "Failed to create tools directory");
         return 1;
@@ -246,7 +277,7 @@ int main(int argc, char **argv) {
     nob_cmd_append(&cmd,
         "cc", "-Wall", "-Wextra",
         "-o", "dice", "dice.c",
-        "-L./build", "-l:libraylib.a", "-I./" RAYLIB_SOURCE_PATH, "-lm",
+        "-L./build", "-l:libraylib.a", "-I./" RAYLIB_SOURCE_PATH, "-lm", "-lpthread",
         "./build/microui.o", "-I./extern/microui/src/",
         "./build/murl.o", "-I./extern/microui-raylib/src/",
         "-I./extern/qop/"
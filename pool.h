@@ -0,0 +1,694 @@
+#ifndef POOL_H
+#define POOL_H
+
+// Growable dice pool stored as fixed size pages.
+//
+// Growing the pool only ever allocates a new page and, once in a while, reallocates
+// the small array of page pointers, so the dice themselves are never copied. A page
+// holds exactly one RNG_BLOCK worth of dice, which lets every page be rolled from its
+// own generator stream on any thread.
+//
+// Pages can hold the dice one per byte, packed as nibbles or packed in base-6 (see
+// kernels.h). The packed forms cut memory, and with it the time of the bandwidth
+// bound reductions, by 2x and 3x, but only fit dice up to d15 and d6.
+//
+// The pool also keeps its running sum, per face histogram and the amount of dice at or
+// above a threshold up to date as dice are added, removed, changed or rolled, so
+// reading any of them never has to walk the pool.
+//
+// Huge pools can be rolled as a histogram only (pool_roll_histogram), which draws the
+// face counts straight from the multinomial distribution in O(sides). Those dice are
+// pending: they count towards every stat but have no place in the pages until
+// pool_materialize writes them out, either shuffled or, after a sort, highest first.
+//
+// #define POOL_IMPLEMENTATION in exactly one file before including this, rng.h and
+// kernels.h have to be included first.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define POOL_PAGE_SIZE RNG_BLOCK
+#define POOL_MAX_FACES 256
+
+typedef struct Die {
+    uint8_t value;
+} Die;
+
+typedef enum PoolStorage {
+    POOL_STORAGE_BYTE,
+    POOL_STORAGE_NIBBLE,
+    POOL_STORAGE_BASE6,
+} PoolStorage;
+
+typedef struct DicePool {
+    uint8_t   **pages;
+    size_t      page_count;    // pages allocated, can be one more than needed
+    size_t      page_capacity; // size of the pages array
+    size_t      count;
+    size_t      stored;        // dice [0, stored) are in the pages, the rest are pending
+    uint32_t    sides;         // biggest kind of die that was put in the pool
+    PoolStorage storage;
+    uint64_t    generation;    // bumped whenever a die changes, copies of the dice compare against it
+
+    uint64_t    sum;
+    uint64_t    face_counts[POOL_MAX_FACES];
+    uint32_t    threshold;
+    uint64_t    successes;     // dice with a value >= threshold
+
+    uint64_t    pending_counts[POOL_MAX_FACES];
+    bool        pending_sorted; // pending dice come out highest first instead of shuffled
+    Rng         pending_rng;    // draws the order the pending dice come out in
+} DicePool;
+
+// Only dice below pool->stored can be read or written, see pool_materialize
+
+static inline Die pool_get(const DicePool *pool, size_t index) {
+    const uint8_t *page = pool->pages[index / POOL_PAGE_SIZE];
+    size_t offset = index % POOL_PAGE_SIZE;
+
+    switch(pool->storage) {
+        case POOL_STORAGE_NIBBLE: return (Die){ .value = (uint8_t)nibble_get(page, offset) };
+        case POOL_STORAGE_BASE6:  return (Die){ .value = (uint8_t)base6_get((const uint16_t*)page, offset) };
+        default:                  return (Die){ .value = page[offset] };
+    }
+}
+
+// Base-6 has no digit for a die that was never rolled, it reads back as a 1
+static inline Die pool_storable(const DicePool *pool, Die die) {
+    if(pool->storage == POOL_STORAGE_BASE6 && die.value == 0) die.value = 1;
+    return die;
+}
+
+static inline void pool_stats_add(DicePool *pool, uint8_t value, int64_t amount) {
+    pool->sum                += (uint64_t)((int64_t)value * amount);
+    pool->face_counts[value] += (uint64_t)amount;
+    if(value >= pool->threshold) pool->successes += (uint64_t)amount;
+}
+
+// Writes the die without touching the stats
+static inline void pool_store(DicePool *pool, size_t index, Die die) {
+    uint8_t *page = pool->pages[index / POOL_PAGE_SIZE];
+    size_t offset = index % POOL_PAGE_SIZE;
+
+    switch(pool->storage) {
+        case POOL_STORAGE_NIBBLE: nibble_set(page, offset, die.value);               break;
+        case POOL_STORAGE_BASE6:  base6_set((uint16_t*)page, offset, die.value);     break;
+        default:                  page[offset] = die.value;                          break;
+    }
+}
+
+static inline void pool_set(DicePool *pool, size_t index, Die die) {
+    die = pool_storable(pool, die);
+    pool->generation++;
+    pool_stats_add(pool, pool_get(pool, index).value, -1);
+    pool_stats_add(pool, die.value, 1);
+    pool_store(pool, index, die);
+}
+
+uint32_t pool_storage_max_sides(PoolStorage storage);
+bool     pool_set_storage(DicePool *pool, PoolStorage storage); // false if the dice do not fit
+
+void     pool_push(DicePool *pool, Die die);
+void     pool_insert_sorted(DicePool *pool, Die die); // keeps a pool that is sorted highest first sorted
+bool     pool_pop(DicePool *pool, Die *die);  // removes the last die, which keeps a sorted pool sorted
+void     pool_resize(DicePool *pool, size_t count); // new dice are 0 (1 in base-6) until rolled
+void     pool_roll(DicePool *pool, Rng *rng, uint32_t sides, size_t threads);
+void     pool_roll_histogram(DicePool *pool, Rng *rng, size_t count, uint32_t sides);
+void     pool_materialize(DicePool *pool, size_t count); // stores the first count dice
+void     pool_set_threshold(DicePool *pool, uint32_t threshold);
+
+// Full scans over the dice, the kept stats are built from these
+uint64_t pool_sum(const DicePool *pool);
+void     pool_face_counts(const DicePool *pool, uint64_t *counts); // counts has POOL_MAX_FACES entries
+uint64_t pool_count_at_least(const DicePool *pool, uint32_t threshold);
+void     pool_sort_descending(DicePool *pool);
+size_t   pool_memory_usage(const DicePool *pool);
+void     pool_free(DicePool *pool);
+
+#endif // POOL_H
+
+#ifdef POOL_IMPLEMENTATION
+#undef POOL_IMPLEMENTATION
+
+#include <stdlib.h>
+#include <string.h>
+
+static size_t pool_page_bytes(PoolStorage storage) {
+    switch(storage) {
+        case POOL_STORAGE_NIBBLE: return POOL_PAGE_SIZE / 2;
+        case POOL_STORAGE_BASE6:  return (POOL_PAGE_SIZE + BASE6_DICE_PER_WORD - 1) / BASE6_DICE_PER_WORD * sizeof(uint16_t);
+        default:                  return POOL_PAGE_SIZE;
+    }
+}
+
+uint32_t pool_storage_max_sides(PoolStorage storage) {
+    switch(storage) {
+        case POOL_STORAGE_NIBBLE: return 15;
+        case POOL_STORAGE_BASE6:  return 6;
+        default:                  return 255;
+    }
+}
+
+static size_t pool_pages_needed(size_t count) {
+    return (count + POOL_PAGE_SIZE - 1) / POOL_PAGE_SIZE;
+}
+
+static size_t pool_page_dice(const DicePool *pool, size_t page) {
+    size_t count = pool->stored - page * POOL_PAGE_SIZE;
+    return count > POOL_PAGE_SIZE ? POOL_PAGE_SIZE : count;
+}
+
+static void pool_reserve_pages(DicePool *pool, size_t pages_needed) {
+    if(pages_needed > pool->page_capacity) {
+        size_t capacity = pool->page_capacity == 0 ? 16 : pool->page_capacity;
+        while(capacity < pages_needed) capacity *= 2;
+
+        pool->pages = realloc(pool->pages, capacity * sizeof(*pool->pages));
+        pool->page_capacity = capacity;
+    }
+
+    while(pool->page_count < pages_needed)
+        pool->pages[pool->page_count++] = calloc(pool_page_bytes(pool->storage), 1);
+}
+
+// Keeps a single spare page around so adding and removing at a page boundary
+// does not hammer the allocator
+static void pool_trim_pages(DicePool *pool) {
+    size_t keep = pool_pages_needed(pool->stored) + 1;
+    while(pool->page_count > keep)
+        free(pool->pages[--pool->page_count]);
+}
+
+static void pool_pack_page(PoolStorage storage, uint8_t *page, const uint8_t *dice, size_t count) {
+    switch(storage) {
+        case POOL_STORAGE_NIBBLE: {
+            size_t i = 0;
+            for(; i + 1 < count; i += 2) page[i / 2] = (uint8_t)(dice[i] | (dice[i + 1] << 4));
+            if(i < count) nibble_set(page, i, dice[i]);
+        } break;
+
+        case POOL_STORAGE_BASE6: {
+            uint16_t *words = (uint16_t*)page;
+            size_t i = 0;
+            for(; i + BASE6_DICE_PER_WORD <= count; i += BASE6_DICE_PER_WORD) {
+                uint32_t word = 0;
+                for(size_t k = BASE6_DICE_PER_WORD; k-- > 0; ) word = word * 6 + (dice[i + k] - 1u);
+                words[i / BASE6_DICE_PER_WORD] = (uint16_t)word;
+            }
+            for(; i < count; i++) base6_set(words, i, dice[i]);
+        } break;
+
+        default: memcpy(page, dice, count); break;
+    }
+}
+
+static void pool_unpack_page(PoolStorage storage, const uint8_t *page, uint8_t *dice, size_t count) {
+    switch(storage) {
+        case POOL_STORAGE_NIBBLE: for(size_t i = 0; i < count; i++) dice[i] = (uint8_t)nibble_get(page, i);                   break;
+        case POOL_STORAGE_BASE6:  for(size_t i = 0; i < count; i++) dice[i] = (uint8_t)base6_get((const uint16_t*)page, i); break;
+        default:                  memcpy(dice, page, count);                                                                   break;
+    }
+}
+
+// Sets count dice starting at start to value, whole words at a time where possible
+static void pool_fill_range(DicePool *pool, size_t start, size_t count, uint8_t value) {
+    size_t end = start + count;
+
+    while(start < end) {
+        uint8_t *page   = pool->pages[start / POOL_PAGE_SIZE];
+        size_t   offset = start % POOL_PAGE_SIZE;
+        size_t   span   = POOL_PAGE_SIZE - offset;
+        if(span > end - start) span = end - start;
+
+        switch(pool->storage) {
+            case POOL_STORAGE_NIBBLE: {
+                size_t i = offset, stop = offset + span;
+                for(; i < stop && (i & 1); i++) nibble_set(page, i, value);
+                size_t whole = (stop - i) / 2 * 2;
+                memset(&page[i / 2], value | (value << 4), whole / 2);
+                for(i += whole; i < stop; i++) nibble_set(page, i, value);
+            } break;
+
+            case POOL_STORAGE_BASE6: {
+                uint16_t *words = (uint16_t*)page;
+                uint32_t  digit = value ? value - 1u : 0;
+                size_t i = offset, stop = offset + span;
+                for(; i < stop && i % BASE6_DICE_PER_WORD != 0; i++) base6_set(words, i, digit + 1);
+                for(; i + BASE6_DICE_PER_WORD <= stop; i += BASE6_DICE_PER_WORD)
+                    words[i / BASE6_DICE_PER_WORD] = (uint16_t)(digit * 9331); // 1+6+36+216+1296+7776 times the digit
+                for(; i < stop; i++) base6_set(words, i, digit + 1);
+            } break;
+
+            default: memset(&page[offset], value, span); break;
+        }
+
+        start += span;
+    }
+}
+
+bool pool_set_storage(DicePool *pool, PoolStorage storage) {
+    pool->generation++;
+
+    if(pool->storage == storage) return true;
+    if(pool->count > 0 && pool->sides > pool_storage_max_sides(storage)) return false;
+
+    uint8_t *dice = malloc(POOL_PAGE_SIZE);
+
+    for(size_t p = 0; p < pool->page_count; p++) {
+        uint8_t *page = calloc(pool_page_bytes(storage), 1);
+
+        if(p * POOL_PAGE_SIZE < pool->stored) {
+            size_t count = pool_page_dice(pool, p);
+            pool_unpack_page(pool->storage, pool->pages[p], dice, count);
+            // Base-6 has no way to store a die that was never rolled
+            if(storage == POOL_STORAGE_BASE6)
+                for(size_t i = 0; i < count; i++) if(dice[i] == 0) dice[i] = 1;
+            pool_pack_page(storage, page, dice, count);
+        }
+
+        free(pool->pages[p]);
+        pool->pages[p] = page;
+    }
+
+    free(dice);
+    pool->storage = storage;
+
+    if(storage == POOL_STORAGE_BASE6 && pool->face_counts[0] > 0) {
+        uint64_t unrolled = pool->face_counts[0];
+        pool_stats_add(pool, 0, -(int64_t)unrolled);
+        pool_stats_add(pool, 1,  (int64_t)unrolled);
+        pool->pending_counts[1] += pool->pending_counts[0];
+        pool->pending_counts[0]  = 0;
+        if(pool->sides < 1) pool->sides = 1;
+    }
+
+    return true;
+}
+
+// Adds the face counts of the dice in [start, end) to counts
+static void pool_count_range(const DicePool *pool, size_t start, size_t end, uint64_t *counts) {
+    uint64_t range_counts[POOL_MAX_FACES] = {0};
+    size_t   total = end - start;
+
+    while(start < end) {
+        const uint8_t *page = pool->pages[start / POOL_PAGE_SIZE];
+        size_t offset = start % POOL_PAGE_SIZE;
+        size_t stop   = offset + (end - start);
+        if(stop > POOL_PAGE_SIZE) stop = POOL_PAGE_SIZE;
+
+        switch(pool->storage) {
+            case POOL_STORAGE_NIBBLE: {
+                size_t i = offset;
+                if(i & 1) range_counts[nibble_get(page, i++)]++;
+                if(i < stop) kernel_face_counts_nibble(page + i / 2, stop - i, pool->sides, range_counts);
+            } break;
+
+            case POOL_STORAGE_BASE6: {
+                const uint16_t *words = (const uint16_t*)page;
+                size_t i = offset;
+                for(; i < stop && i % BASE6_DICE_PER_WORD != 0; i++) range_counts[base6_get(words, i)]++;
+                if(i < stop) kernel_face_counts_base6(words + i / BASE6_DICE_PER_WORD, stop - i, range_counts);
+            } break;
+
+            default: kernel_face_counts_u8(page + offset, stop - offset, pool->sides, range_counts); break;
+        }
+
+        start += stop - offset;
+    }
+
+    // The kernels do not all count dice that were never rolled, so those are
+    // whatever is left over
+    uint64_t rolled = 0;
+    for(uint32_t value = 1; value < POOL_MAX_FACES; value++) {
+        rolled        += range_counts[value];
+        counts[value] += range_counts[value];
+    }
+    counts[0] += total - rolled;
+}
+
+// Picks the pending die that x falls on, x is in [0, pending dice)
+static uint8_t pool_pending_at(const DicePool *pool, uint64_t x) {
+    uint32_t value = 0;
+    while(x >= pool->pending_counts[value]) x -= pool->pending_counts[value++];
+    return (uint8_t)value;
+}
+
+// Uniform in [0, bound) from 64 random bits, the bias is at most bound / 2^64
+static uint64_t pool_pending_index(const uint32_t bits[2], uint64_t bound) {
+    uint64_t x = ((uint64_t)bits[0] << 32) | bits[1];
+    return (uint64_t)(((unsigned __int128)x * bound) >> 64);
+}
+
+// Takes one die out of the pending ones, the last one in the order they would come out in
+static uint8_t pool_take_pending(DicePool *pool) {
+    uint8_t value = 0;
+
+    if(pool->pending_sorted) {
+        while(pool->pending_counts[value] == 0) value++;
+    } else {
+        uint32_t bits[2];
+        rng_fill_u32(&pool->pending_rng, bits, 2);
+        value = pool_pending_at(pool, pool_pending_index(bits, pool->count - pool->stored));
+    }
+
+    pool->pending_counts[value]--;
+    return value;
+}
+
+// Removes amount pending dice from the end
+static void pool_drop_pending(DicePool *pool, size_t amount) {
+    size_t   pending = pool->count - pool->stored;
+    uint64_t removed[POOL_MAX_FACES] = {0};
+
+    if(pool->pending_sorted || amount == pending) {
+        // Sorted dice come out highest first, so the last ones are the lowest
+        uint64_t left = amount;
+        for(uint32_t value = 0; value < POOL_MAX_FACES && left > 0; value++) {
+            uint64_t take = pool->pending_counts[value] < left ? pool->pending_counts[value] : left;
+            removed[value]               = take;
+            pool->pending_counts[value] -= take;
+            left                        -= take;
+        }
+    } else if(amount <= pending - amount) {
+        for(size_t i = 0; i < amount; i++) {
+            removed[pool_take_pending(pool)]++;
+            pool->count--;
+        }
+    } else {
+        // Cheaper to draw the dice that stay and drop whatever is left
+        uint64_t kept[POOL_MAX_FACES] = {0};
+        for(size_t i = 0; i < pending - amount; i++) {
+            kept[pool_take_pending(pool)]++;
+            pool->count--;
+        }
+        memcpy(removed, pool->pending_counts, sizeof(removed));
+        memcpy(pool->pending_counts, kept, sizeof(kept));
+    }
+
+    pool->count = pool->stored + pending - amount;
+    for(uint32_t value = 0; value < POOL_MAX_FACES; value++)
+        if(removed[value] > 0) pool_stats_add(pool, (uint8_t)value, -(int64_t)removed[value]);
+}
+
+void pool_push(DicePool *pool, Die die) {
+    pool->generation++;
+
+    if(die.value > pool->sides) pool->sides = die.value;
+    if(die.value > pool_storage_max_sides(pool->storage)) pool_set_storage(pool, POOL_STORAGE_BYTE);
+
+    die = pool_storable(pool, die);
+    pool_stats_add(pool, die.value, 1);
+
+    if(pool->stored < pool->count) {
+        pool->pending_counts[die.value]++;
+        pool->count++;
+        return;
+    }
+
+    if(pool->count % POOL_PAGE_SIZE == 0)
+        pool_reserve_pages(pool, pool->count / POOL_PAGE_SIZE + 1);
+
+    pool_store(pool, pool->count, die);
+    pool->count++;
+    pool->stored++;
+}
+
+// A sorted pool is a run of dice per face, highest first. Every run below the new die
+// moves up by one by taking its first die to its end, so only one die per face is
+// ever written instead of shifting everything after the insertion point
+void pool_insert_sorted(DicePool *pool, Die die) {
+    pool->generation++;
+
+    if(pool->stored < pool->count) {
+        pool_push(pool, die);
+        pool_sort_descending(pool);
+        return;
+    }
+
+    die = pool_storable(pool, die);
+    size_t hole = pool->count;
+    pool_push(pool, die);
+
+    for(uint32_t value = 0; value < die.value; value++) {
+        uint64_t run = pool->face_counts[value];
+        if(run == 0) continue;
+
+        pool_store(pool, hole, (Die){ .value = (uint8_t)value });
+        hole -= run;
+    }
+
+    pool_store(pool, hole, die);
+}
+
+bool pool_pop(DicePool *pool, Die *die) {
+    pool->generation++;
+
+    if(pool->count == 0) return false;
+
+    Die removed;
+    if(pool->stored < pool->count) {
+        removed.value = pool_take_pending(pool);
+        pool->count--;
+    } else {
+        pool->count--;
+        pool->stored--;
+        removed = pool_get(pool, pool->count);
+        if(pool->count % POOL_PAGE_SIZE == 0) pool_trim_pages(pool);
+    }
+
+    pool_stats_add(pool, removed.value, -1);
+    if(die != NULL) *die = removed;
+
+    return true;
+}
+
+void pool_resize(DicePool *pool, size_t count) {
+    pool->generation++;
+
+    if(count > pool->count) {
+        // Pages that are reused may still hold old values
+        Die fresh = pool_storable(pool, (Die){0});
+        if(fresh.value > pool->sides) pool->sides = fresh.value;
+        pool_stats_add(pool, fresh.value, (int64_t)(count - pool->count));
+
+        if(pool->stored < pool->count) {
+            pool->pending_counts[fresh.value] += count - pool->count;
+        } else {
+            pool_reserve_pages(pool, pool_pages_needed(count));
+            pool_fill_range(pool, pool->count, count - pool->count, fresh.value);
+            pool->stored = count;
+        }
+    } else if(count < pool->count) {
+        if(count >= pool->stored) {
+            pool_drop_pending(pool, pool->count - count);
+        } else {
+            pool_drop_pending(pool, pool->count - pool->stored);
+
+            uint64_t removed[POOL_MAX_FACES] = {0};
+            pool_count_range(pool, count, pool->stored, removed);
+            for(uint32_t value = 0; value < POOL_MAX_FACES; value++)
+                if(removed[value] > 0) pool_stats_add(pool, (uint8_t)value, -(int64_t)removed[value]);
+            pool->stored = count;
+        }
+    }
+
+    pool->count = count;
+    pool_trim_pages(pool);
+}
+
+typedef struct PoolRollJob {
+    DicePool *pool;
+    uint32_t  sides;
+    uint64_t *page_counts; // sides + 1 counts per page
+} PoolRollJob;
+
+// Counts every page while it is still hot in cache from rolling it
+static void pool_roll_page(void *user, Rng *stream, size_t page, size_t count) {
+    PoolRollJob *job = user;
+    uint64_t *counts = &job->page_counts[page * (job->sides + 1)];
+
+    if(job->pool->storage == POOL_STORAGE_BYTE) {
+        rng_fill_dice(stream, job->pool->pages[page], count, job->sides);
+        kernel_face_counts_u8(job->pool->pages[page], count, job->sides, counts);
+    } else {
+        uint8_t dice[POOL_PAGE_SIZE];
+        rng_fill_dice(stream, dice, count, job->sides);
+        kernel_face_counts_u8(dice, count, job->sides, counts);
+        pool_pack_page(job->pool->storage, job->pool->pages[page], dice, count);
+    }
+}
+
+void pool_roll(DicePool *pool, Rng *rng, uint32_t sides, size_t threads) {
+    pool->generation++;
+
+    if(pool->count == 0) return;
+
+    pool->sides = sides;
+    if(sides > pool_storage_max_sides(pool->storage)) pool_set_storage(pool, POOL_STORAGE_BYTE);
+
+    size_t page_count = pool_pages_needed(pool->count);
+    pool_reserve_pages(pool, page_count);
+    pool->stored = pool->count;
+    memset(pool->pending_counts, 0, sizeof(pool->pending_counts));
+    PoolRollJob job = {
+        .pool        = pool,
+        .sides       = sides,
+        .page_counts = calloc(page_count * (sides + 1), sizeof(uint64_t)),
+    };
+
+    rng_run_blocks(rng, pool->count, threads, pool_roll_page, &job);
+
+    memset(pool->face_counts, 0, sizeof(pool->face_counts));
+    for(size_t p = 0; p < page_count; p++)
+        for(uint32_t value = 1; value <= sides; value++)
+            pool->face_counts[value] += job.page_counts[p * (sides + 1) + value];
+
+    free(job.page_counts);
+
+    pool->sum = 0;
+    for(uint32_t value = 1; value <= sides; value++) pool->sum += (uint64_t)value * pool->face_counts[value];
+    pool_set_threshold(pool, pool->threshold);
+}
+
+void pool_roll_histogram(DicePool *pool, Rng *rng, size_t count, uint32_t sides) {
+    pool->generation++;
+
+    pool->count  = count;
+    pool->stored = 0;
+    pool_trim_pages(pool);
+
+    if(sides > pool_storage_max_sides(pool->storage)) pool_set_storage(pool, POOL_STORAGE_BYTE);
+    pool->sides = sides;
+
+    memset(pool->pending_counts, 0, sizeof(pool->pending_counts));
+    rng_multinomial_dice(rng, count, sides, pool->pending_counts);
+    memcpy(pool->face_counts, pool->pending_counts, sizeof(pool->face_counts));
+
+    // The pool keeps its own stream for shuffling the dice out later on
+    pool->pending_sorted = false;
+    pool->pending_rng    = *rng;
+    rng_long_jump(rng);
+
+    pool->sum = 0;
+    for(uint32_t value = 1; value <= sides; value++) pool->sum += (uint64_t)value * pool->face_counts[value];
+    pool_set_threshold(pool, pool->threshold);
+}
+
+#define POOL_DRAW_BATCH 512
+
+void pool_materialize(DicePool *pool, size_t count) {
+    if(count > pool->count) count = pool->count;
+    if(count <= pool->stored) return;
+
+    pool_reserve_pages(pool, pool_pages_needed(count));
+
+    if(pool->pending_sorted) {
+        for(uint32_t value = POOL_MAX_FACES; value-- > 0 && pool->stored < count; ) {
+            uint64_t amount = pool->pending_counts[value];
+            if(amount > count - pool->stored) amount = count - pool->stored;
+
+            pool_fill_range(pool, pool->stored, amount, (uint8_t)value);
+            pool->pending_counts[value] -= amount;
+            pool->stored += amount;
+        }
+        return;
+    }
+
+    // Drawing the dice one by one without replacement gives every order of the
+    // pending dice the same chance, same as a shuffle but written front to back
+    uint32_t bits[2 * POOL_DRAW_BATCH];
+    while(pool->stored < count) {
+        size_t batch = count - pool->stored;
+        if(batch > POOL_DRAW_BATCH) batch = POOL_DRAW_BATCH;
+        rng_fill_u32(&pool->pending_rng, bits, batch * 2);
+
+        for(size_t i = 0; i < batch; i++) {
+            uint8_t value = pool_pending_at(pool, pool_pending_index(&bits[i * 2], pool->count - pool->stored));
+            pool->pending_counts[value]--;
+            pool_store(pool, pool->stored++, (Die){ .value = value });
+        }
+    }
+}
+
+void pool_set_threshold(DicePool *pool, uint32_t threshold) {
+    pool->threshold = threshold;
+    pool->successes = 0;
+    for(uint32_t value = threshold; value < POOL_MAX_FACES; value++) pool->successes += pool->face_counts[value];
+}
+
+uint64_t pool_sum(const DicePool *pool) {
+    uint64_t total = 0;
+    for(uint32_t value = 1; value < POOL_MAX_FACES; value++) total += (uint64_t)value * pool->pending_counts[value];
+
+    for(size_t p = 0; p * POOL_PAGE_SIZE < pool->stored; p++) {
+        size_t count = pool_page_dice(pool, p);
+
+        switch(pool->storage) {
+            case POOL_STORAGE_NIBBLE: total += kernel_sum_nibble(pool->pages[p], count);                  break;
+            case POOL_STORAGE_BASE6:  total += kernel_sum_base6((const uint16_t*)pool->pages[p], count); break;
+            default:                  total += kernel_sum_u8(pool->pages[p], count);                      break;
+        }
+    }
+
+    return total;
+}
+
+void pool_face_counts(const DicePool *pool, uint64_t *counts) {
+    memcpy(counts, pool->pending_counts, POOL_MAX_FACES * sizeof(*counts));
+    pool_count_range(pool, 0, pool->stored, counts);
+}
+
+uint64_t pool_count_at_least(const DicePool *pool, uint32_t threshold) {
+    uint64_t total = 0;
+    for(uint32_t value = threshold; value < POOL_MAX_FACES; value++) total += pool->pending_counts[value];
+
+    for(size_t p = 0; p * POOL_PAGE_SIZE < pool->stored; p++) {
+        size_t count = pool_page_dice(pool, p);
+        const uint8_t *page = pool->pages[p];
+
+        switch(pool->storage) {
+            case POOL_STORAGE_NIBBLE: total += kernel_count_at_least_nibble(page, count, threshold);                  break;
+            case POOL_STORAGE_BASE6:  total += kernel_count_at_least_base6((const uint16_t*)page, count, threshold); break;
+            default:                  total += kernel_count_at_least_u8(page, count, threshold);                      break;
+        }
+    }
+
+    return total;
+}
+
+// Dice only take a handful of different values, so writing them back in order
+// straight from the histogram beats any comparison sort and works across pages.
+// A pool with pending dice just hands all of them back to be written out in order
+void pool_sort_descending(DicePool *pool) {
+    pool->generation++;
+
+    if(pool->stored < pool->count) {
+        memcpy(pool->pending_counts, pool->face_counts, sizeof(pool->pending_counts));
+        pool->pending_sorted = true;
+        pool->stored         = 0;
+        pool_trim_pages(pool);
+        return;
+    }
+
+    size_t index = 0;
+    for(uint32_t value = pool->sides + 1; value-- > 0; ) {
+        pool_fill_range(pool, index, pool->face_counts[value], (uint8_t)value);
+        index += pool->face_counts[value];
+    }
+}
+
+size_t pool_memory_usage(const DicePool *pool) {
+    return pool->page_count * pool_page_bytes(pool->storage) + pool->page_capacity * sizeof(*pool->pages);
+}
+
+void pool_free(DicePool *pool) {
+    PoolStorage storage   = pool->storage;
+    uint32_t    threshold = pool->threshold;
+
+    for(size_t p = 0; p < pool->page_count; p++) free(pool->pages[p]);
+    free(pool->pages);
+    *pool = (DicePool){ .storage = storage, .threshold = threshold };
+}
+
+#endif // POOL_IMPLEMENTATION
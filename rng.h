@@ -0,0 +1,539 @@
+#ifndef RNG_H
+#define RNG_H
+
+// Multi-lane Xoshiro128** generator for rolling large amounts of dice at once.
+//
+// The state holds RNG_LANES independent Xoshiro128** generators stored lane-major,
+// so one step of every lane is a handful of SIMD instructions. The AVX2, SSE2 and
+// scalar paths all produce the exact same output, the instruction set only changes
+// the speed. Values are reduced to a range with Lemire's multiply-shift method and
+// rejection, so there is no modulo bias.
+//
+// For rolling on several cores every worker needs its own stream. rng_jump advances
+// every lane by 2^64 steps and rng_long_jump by 2^96, so streams handed out by
+// rng_split never overlap. The parallel fill splits the output into RNG_BLOCK sized
+// blocks, each with its own jumped stream, which makes the result depend only on the
+// seed and never on how many threads did the work.
+//
+// #define RNG_IMPLEMENTATION in exactly one file before including this.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define RNG_LANES 8
+
+typedef struct Rng {
+    uint32_t s[4][RNG_LANES];
+} Rng;
+
+void     rng_seed(Rng *rng, uint64_t seed);
+void     rng_fill_u32(Rng *rng, uint32_t *out, size_t n);
+void     rng_fill_dice(Rng *rng, uint8_t *out, size_t n, uint32_t sides); // values in [1, sides], sides <= 255
+uint32_t rng_range(Rng *rng, uint32_t sides);                            // single value in [1, sides]
+
+double   rng_uniform(Rng *rng);                              // [0, 1) with 53 bits
+uint64_t rng_binomial(Rng *rng, uint64_t n, double p);
+void     rng_multinomial_dice(Rng *rng, uint64_t n, uint32_t sides, uint64_t *counts); // counts[1..sides]
+
+void rng_jump(Rng *rng);                                   // advance every lane by 2^64 steps
+void rng_long_jump(Rng *rng);                              // advance every lane by 2^96 steps
+void rng_split(Rng *rng, Rng *streams, size_t count);      // hand out count non-overlapping streams
+
+#define RNG_BLOCK 65536
+
+// Runs fn once per RNG_BLOCK sized block of n items, spread over threads. Block i gets
+// the generator jumped i times, afterwards rng is past every block.
+typedef void (*RngBlockFn)(void *user, Rng *stream, size_t block, size_t count);
+void rng_run_blocks(Rng *rng, size_t n, size_t threads, RngBlockFn fn, void *user);
+
+// Rolls n dice spread over RNG_BLOCK sized blocks (the last one may be partial)
+void rng_fill_dice_blocks(Rng *rng, uint8_t **blocks, size_t n, uint32_t sides, size_t threads);
+void rng_fill_dice_parallel(Rng *rng, uint8_t *out, size_t n, uint32_t sides, size_t threads);
+
+#endif // RNG_H
+
+#ifdef RNG_IMPLEMENTATION
+#undef RNG_IMPLEMENTATION
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+    #define RNG_X86
+    #include <immintrin.h>
+#endif
+
+static inline uint32_t rng_rotl(uint32_t x, int k) {
+    return (x << k) | (x >> (32 - k));
+}
+
+static uint64_t rng_splitmix64(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+void rng_seed(Rng *rng, uint64_t seed) {
+    // Every lane gets its own SplitMix64 output, same as rprand does for its single state
+    uint64_t state = seed;
+    for(size_t lane = 0; lane < RNG_LANES; lane++) {
+        uint64_t a = rng_splitmix64(&state);
+        uint64_t b = rng_splitmix64(&state);
+        rng->s[0][lane] = (uint32_t)a;
+        rng->s[1][lane] = (uint32_t)(a >> 32);
+        rng->s[2][lane] = (uint32_t)b;
+        rng->s[3][lane] = (uint32_t)(b >> 32);
+    }
+}
+
+static void rng_rounds_scalar(Rng *rng, uint32_t *out, size_t rounds) {
+    for(size_t r = 0; r < rounds; r++) {
+        for(size_t lane = 0; lane < RNG_LANES; lane++) {
+            uint32_t s0 = rng->s[0][lane];
+            uint32_t s1 = rng->s[1][lane];
+            uint32_t s2 = rng->s[2][lane];
+            uint32_t s3 = rng->s[3][lane];
+
+            out[r*RNG_LANES + lane] = rng_rotl(s1 * 5, 7) * 9;
+
+            uint32_t t = s1 << 9;
+            s2 ^= s0;
+            s3 ^= s1;
+            s1 ^= s2;
+            s0 ^= s3;
+            s2 ^= t;
+            s3  = rng_rotl(s3, 11);
+
+            rng->s[0][lane] = s0;
+            rng->s[1][lane] = s1;
+            rng->s[2][lane] = s2;
+            rng->s[3][lane] = s3;
+        }
+    }
+}
+
+#ifdef RNG_X86
+
+__attribute__((target("avx2")))
+static void rng_rounds_avx2(Rng *rng, uint32_t *out, size_t rounds) {
+    __m256i s0 = _mm256_loadu_si256((const __m256i*)rng->s[0]);
+    __m256i s1 = _mm256_loadu_si256((const __m256i*)rng->s[1]);
+    __m256i s2 = _mm256_loadu_si256((const __m256i*)rng->s[2]);
+    __m256i s3 = _mm256_loadu_si256((const __m256i*)rng->s[3]);
+
+    for(size_t r = 0; r < rounds; r++) {
+        __m256i x = _mm256_add_epi32(_mm256_slli_epi32(s1, 2), s1);             // s1 * 5
+        x = _mm256_or_si256(_mm256_slli_epi32(x, 7), _mm256_srli_epi32(x, 25)); // rotl 7
+        x = _mm256_add_epi32(_mm256_slli_epi32(x, 3), x);                       // * 9
+        _mm256_storeu_si256((__m256i*)(out + r*RNG_LANES), x);
+
+        __m256i t = _mm256_slli_epi32(s1, 9);
+        s2 = _mm256_xor_si256(s2, s0);
+        s3 = _mm256_xor_si256(s3, s1);
+        s1 = _mm256_xor_si256(s1, s2);
+        s0 = _mm256_xor_si256(s0, s3);
+        s2 = _mm256_xor_si256(s2, t);
+        s3 = _mm256_or_si256(_mm256_slli_epi32(s3, 11), _mm256_srli_epi32(s3, 21));
+    }
+
+    _mm256_storeu_si256((__m256i*)rng->s[0], s0);
+    _mm256_storeu_si256((__m256i*)rng->s[1], s1);
+    _mm256_storeu_si256((__m256i*)rng->s[2], s2);
+    _mm256_storeu_si256((__m256i*)rng->s[3], s3);
+}
+
+// SSE2 only has 4 lanes per register, so the 8 lanes are stepped as two halves
+__attribute__((target("sse2")))
+static void rng_rounds_sse2(Rng *rng, uint32_t *out, size_t rounds) {
+    for(size_t half = 0; half < RNG_LANES; half += 4) {
+        __m128i s0 = _mm_loadu_si128((const __m128i*)&rng->s[0][half]);
+        __m128i s1 = _mm_loadu_si128((const __m128i*)&rng->s[1][half]);
+        __m128i s2 = _mm_loadu_si128((const __m128i*)&rng->s[2][half]);
+        __m128i s3 = _mm_loadu_si128((const __m128i*)&rng->s[3][half]);
+
+        for(size_t r = 0; r < rounds; r++) {
+            __m128i x = _mm_add_epi32(_mm_slli_epi32(s1, 2), s1);
+            x = _mm_or_si128(_mm_slli_epi32(x, 7), _mm_srli_epi32(x, 25));
+            x = _mm_add_epi32(_mm_slli_epi32(x, 3), x);
+            _mm_storeu_si128((__m128i*)(out + r*RNG_LANES + half), x);
+
+            __m128i t = _mm_slli_epi32(s1, 9);
+            s2 = _mm_xor_si128(s2, s0);
+            s3 = _mm_xor_si128(s3, s1);
+            s1 = _mm_xor_si128(s1, s2);
+            s0 = _mm_xor_si128(s0, s3);
+            s2 = _mm_xor_si128(s2, t);
+            s3 = _mm_or_si128(_mm_slli_epi32(s3, 11), _mm_srli_epi32(s3, 21));
+        }
+
+        _mm_storeu_si128((__m128i*)&rng->s[0][half], s0);
+        _mm_storeu_si128((__m128i*)&rng->s[1][half], s1);
+        _mm_storeu_si128((__m128i*)&rng->s[2][half], s2);
+        _mm_storeu_si128((__m128i*)&rng->s[3][half], s3);
+    }
+}
+
+#endif // RNG_X86
+
+// Writes rounds * RNG_LANES values
+static void rng_rounds(Rng *rng, uint32_t *out, size_t rounds) {
+#ifdef RNG_X86
+    // Any number of threads can get here first, they all work out the same level
+    static _Atomic int cpu_level = -1;
+    int level = atomic_load_explicit(&cpu_level, memory_order_relaxed);
+    if(level < 0) {
+        level = __builtin_cpu_supports("avx2") ? 2 : __builtin_cpu_supports("sse2") ? 1 : 0;
+        atomic_store_explicit(&cpu_level, level, memory_order_relaxed);
+    }
+
+    if(level == 2)      rng_rounds_avx2(rng, out, rounds);
+    else if(level == 1) rng_rounds_sse2(rng, out, rounds);
+    else                rng_rounds_scalar(rng, out, rounds);
+#else
+    rng_rounds_scalar(rng, out, rounds);
+#endif
+}
+
+void rng_fill_u32(Rng *rng, uint32_t *out, size_t n) {
+    size_t rounds = n / RNG_LANES;
+    rng_rounds(rng, out, rounds);
+
+    size_t rest = n - rounds * RNG_LANES;
+    if(rest > 0) {
+        // The leftover lanes of the last round are thrown away
+        uint32_t tail[RNG_LANES];
+        rng_rounds(rng, tail, 1);
+        for(size_t i = 0; i < rest; i++) out[rounds * RNG_LANES + i] = tail[i];
+    }
+}
+
+// Lemire's nearly divisionless range reduction, https://arxiv.org/abs/1805.10941
+// Returns a value in [0, sides)
+static inline uint32_t rng_reduce(Rng *rng, uint32_t x, uint32_t sides) {
+    uint64_t m = (uint64_t)x * sides;
+    uint32_t l = (uint32_t)m;
+
+    if(l < sides) {
+        uint32_t threshold = -sides % sides;
+        while(l < threshold) {
+            rng_fill_u32(rng, &x, 1);
+            m = (uint64_t)x * sides;
+            l = (uint32_t)m;
+        }
+    }
+
+    return (uint32_t)(m >> 32);
+}
+
+#define RNG_CHUNK 1024
+
+void rng_fill_dice(Rng *rng, uint8_t *out, size_t n, uint32_t sides) {
+    uint32_t chunk[RNG_CHUNK];
+
+    while(n > 0) {
+        size_t count = n < RNG_CHUNK ? n : RNG_CHUNK;
+        rng_fill_u32(rng, chunk, count);
+
+        // Fast pass without the rejection branch so it vectorizes. Only when some value
+        // lands in the (tiny) rejection zone is the chunk redone the careful way.
+        uint32_t maybe_biased = 0;
+        for(size_t i = 0; i < count; i++) {
+            uint64_t m = (uint64_t)chunk[i] * sides;
+            maybe_biased |= (uint32_t)m < sides;
+            out[i] = (uint8_t)((m >> 32) + 1);
+        }
+
+        if(maybe_biased) {
+            for(size_t i = 0; i < count; i++)
+                out[i] = (uint8_t)(rng_reduce(rng, chunk[i], sides) + 1);
+        }
+
+        out += count;
+        n   -= count;
+    }
+}
+
+uint32_t rng_range(Rng *rng, uint32_t sides) {
+    uint32_t x;
+    rng_fill_u32(rng, &x, 1);
+    return rng_reduce(rng, x, sides) + 1;
+}
+
+double rng_uniform(Rng *rng) {
+    uint32_t x[2];
+    rng_fill_u32(rng, x, 2);
+    return (double)(((uint64_t)x[0] << 21) ^ (x[1] >> 11)) * 0x1.0p-53;
+}
+
+// Inversion, for when n * p is small. p <= 0.5
+static uint64_t rng_binomial_inversion(Rng *rng, uint64_t n, double p) {
+    double q     = 1.0 - p;
+    double qn    = exp((double)n * log(q));
+    double np    = (double)n * p;
+    double bound = fmin((double)n, np + 10.0 * sqrt(np * q + 1.0));
+
+    uint64_t x  = 0;
+    double   px = qn;
+    double   u  = rng_uniform(rng);
+
+    while(u > px) {
+        x++;
+        if((double)x > bound) {
+            x  = 0;
+            px = qn;
+            u  = rng_uniform(rng);
+        } else {
+            u  -= px;
+            px  = ((double)(n - x + 1) * p * px) / ((double)x * q);
+        }
+    }
+
+    return x;
+}
+
+// BTPE from Kachitvichyanukul & Schmeiser, "Binomial random variate generation" (1988),
+// constant expected time no matter how big n gets. p <= 0.5
+static uint64_t rng_binomial_btpe(Rng *rng, uint64_t n_int, double p) {
+    double n   = (double)n_int;
+    double r   = p;
+    double q   = 1.0 - r;
+    double nrq = n * r * q;
+    double fm  = n * r + r;
+    double m   = floor(fm);
+
+    double p1   = floor(2.195 * sqrt(nrq) - 4.6 * q) + 0.5;
+    double xm   = m + 0.5;
+    double xl   = xm - p1;
+    double xr   = xm + p1;
+    double c    = 0.134 + 20.5 / (15.3 + m);
+    double a    = (fm - xl) / (fm - xl * r);
+    double laml = a * (1.0 + a / 2.0);
+    a           = (xr - fm) / (xr * q);
+    double lamr = a * (1.0 + a / 2.0);
+    double p2   = p1 * (1.0 + 2.0 * c);
+    double p3   = p2 + c / laml;
+    double p4   = p3 + c / lamr;
+
+    for(;;) {
+        double u = rng_uniform(rng) * p4;
+        double v = rng_uniform(rng);
+        double y;
+
+        if(u <= p1) {
+            // Triangular region, accepted straight away
+            return (uint64_t)floor(xm - p1 * v + u);
+        } else if(u <= p2) {
+            // Parallelograms
+            double x = xl + (u - p1) / c;
+            v = v * c + 1.0 - fabs(m - x + 0.5) / p1;
+            if(v > 1.0) continue;
+            y = floor(x);
+        } else if(u <= p3) {
+            // Left exponential tail
+            y = floor(xl + log(v) / laml);
+            if(y < 0.0 || v == 0.0) continue;
+            v = v * (u - p2) * laml;
+        } else {
+            // Right exponential tail
+            y = floor(xr - log(v) / lamr);
+            if(y > n || v == 0.0) continue;
+            v = v * (u - p3) * lamr;
+        }
+
+        double k = fabs(y - m);
+        if(k <= 20.0 || k >= nrq / 2.0 - 1.0) {
+            // Explicit evaluation of f(y) / f(m)
+            double s = r / q;
+            double b = s * (n + 1.0);
+            double f = 1.0;
+            if(m < y)      for(double i = m + 1.0; i <= y; i += 1.0) f *= b / i - s;
+            else if(m > y) for(double i = y + 1.0; i <= m; i += 1.0) f /= b / i - s;
+            if(v > f) continue;
+            return (uint64_t)y;
+        }
+
+        // Squeeze with the normal approximation, then the Stirling based bound
+        double rho = (k / nrq) * ((k * (k / 3.0 + 0.625) + 0.16666666666666666) / nrq + 0.5);
+        double t   = -k * k / (2.0 * nrq);
+        double la  = log(v);
+        if(la < t - rho) return (uint64_t)y;
+        if(la > t + rho) continue;
+
+        double x1 = y + 1.0;
+        double f1 = m + 1.0;
+        double z  = n + 1.0 - m;
+        double w  = n - y + 1.0;
+        double x2 = x1 * x1;
+        double f2 = f1 * f1;
+        double z2 = z * z;
+        double w2 = w * w;
+
+        double bound = xm * log(f1 / x1) + (n - m + 0.5) * log(z / w) + (y - m) * log(w * r / (x1 * q))
+                     + (13680. - (462. - (132. - (99. - 140. / f2) / f2) / f2) / f2) / f1 / 166320.
+                     + (13680. - (462. - (132. - (99. - 140. / z2) / z2) / z2) / z2) / z  / 166320.
+                     + (13680. - (462. - (132. - (99. - 140. / x2) / x2) / x2) / x2) / x1 / 166320.
+                     + (13680. - (462. - (132. - (99. - 140. / w2) / w2) / w2) / w2) / w  / 166320.;
+        if(la > bound) continue;
+
+        return (uint64_t)y;
+    }
+}
+
+uint64_t rng_binomial(Rng *rng, uint64_t n, double p) {
+    if(n == 0 || p <= 0.0) return 0;
+    if(p >= 1.0)           return n;
+
+    double   r = p <= 0.5 ? p : 1.0 - p;
+    uint64_t x = (double)n * r < 30.0 ? rng_binomial_inversion(rng, n, r) : rng_binomial_btpe(rng, n, r);
+
+    return p <= 0.5 ? x : n - x;
+}
+
+// Face counts of n fair dice, as a chain of binomials: each face takes its share of
+// whatever the faces before it did not
+void rng_multinomial_dice(Rng *rng, uint64_t n, uint32_t sides, uint64_t *counts) {
+    for(uint32_t face = 1; face < sides; face++) {
+        counts[face] = rng_binomial(rng, n, 1.0 / (double)(sides - face + 1));
+        n -= counts[face];
+    }
+    if(sides > 0) counts[sides] = n;
+}
+
+static void rng_apply_jump(Rng *rng, const uint32_t jump[4]) {
+    uint32_t acc[4][RNG_LANES] = {0};
+    uint32_t scratch[RNG_LANES];
+
+    for(size_t i = 0; i < 4; i++) {
+        for(size_t b = 0; b < 32; b++) {
+            if(jump[i] & (1u << b)) {
+                for(size_t w = 0; w < 4; w++)
+                    for(size_t lane = 0; lane < RNG_LANES; lane++)
+                        acc[w][lane] ^= rng->s[w][lane];
+            }
+            rng_rounds(rng, scratch, 1);
+        }
+    }
+
+    memcpy(rng->s, acc, sizeof(acc));
+}
+
+// Polynomials from https://prng.di.unimi.it/xoshiro128starstar.c
+void rng_jump(Rng *rng) {
+    static const uint32_t jump[4] = { 0x8764000b, 0xf542d2d3, 0x6fa035c3, 0x77f2db5b };
+    rng_apply_jump(rng, jump);
+}
+
+void rng_long_jump(Rng *rng) {
+    static const uint32_t long_jump[4] = { 0xb523952e, 0x0b6f099f, 0xccf5a0ef, 0x1c580662 };
+    rng_apply_jump(rng, long_jump);
+}
+
+void rng_split(Rng *rng, Rng *streams, size_t count) {
+    for(size_t i = 0; i < count; i++) {
+        streams[i] = *rng;
+        rng_long_jump(rng);
+    }
+}
+
+typedef struct RngBlockJob {
+    Rng        *streams;
+    size_t      first_block;
+    size_t      block_count;
+    size_t      n;
+    RngBlockFn  fn;
+    void       *user;
+} RngBlockJob;
+
+static void *rng_block_worker(void *arg) {
+    RngBlockJob *job = arg;
+
+    for(size_t b = job->first_block; b < job->first_block + job->block_count; b++) {
+        size_t start = b * RNG_BLOCK;
+        size_t count = job->n - start < RNG_BLOCK ? job->n - start : RNG_BLOCK;
+        job->fn(job->user, &job->streams[b], b, count);
+    }
+
+    return NULL;
+}
+
+#define RNG_MAX_THREADS 256
+
+void rng_run_blocks(Rng *rng, size_t n, size_t threads, RngBlockFn fn, void *user) {
+    size_t block_count = (n + RNG_BLOCK - 1) / RNG_BLOCK;
+    if(block_count == 0) return;
+
+    Rng *streams = malloc(block_count * sizeof(Rng));
+    for(size_t b = 0; b < block_count; b++) {
+        streams[b] = *rng;
+        rng_jump(rng);
+    }
+
+    if(threads > block_count)     threads = block_count;
+    if(threads > RNG_MAX_THREADS) threads = RNG_MAX_THREADS;
+    if(threads < 1)               threads = 1;
+
+    RngBlockJob jobs[RNG_MAX_THREADS];
+    pthread_t   workers[RNG_MAX_THREADS];
+
+    size_t next_block = 0;
+    for(size_t t = 0; t < threads; t++) {
+        size_t share = block_count / threads + (t < block_count % threads ? 1 : 0);
+        jobs[t] = (RngBlockJob) {
+            .streams     = streams,
+            .first_block = next_block,
+            .block_count = share,
+            .n           = n,
+            .fn          = fn,
+            .user        = user,
+        };
+        next_block += share;
+    }
+
+    // The calling thread takes the first share itself, and any share whose thread
+    // could not be started
+    bool spawned[RNG_MAX_THREADS] = {0};
+    for(size_t t = 1; t < threads; t++)
+        spawned[t] = pthread_create(&workers[t], NULL, rng_block_worker, &jobs[t]) == 0;
+
+    rng_block_worker(&jobs[0]);
+
+    for(size_t t = 1; t < threads; t++) {
+        if(spawned[t]) pthread_join(workers[t], NULL);
+        else           rng_block_worker(&jobs[t]);
+    }
+
+    free(streams);
+}
+
+typedef struct RngDiceBlocks {
+    uint8_t **blocks;
+    uint32_t  sides;
+} RngDiceBlocks;
+
+static void rng_fill_dice_block(void *user, Rng *stream, size_t block, size_t count) {
+    RngDiceBlocks *dice = user;
+    rng_fill_dice(stream, dice->blocks[block], count, dice->sides);
+}
+
+void rng_fill_dice_blocks(Rng *rng, uint8_t **blocks, size_t n, uint32_t sides, size_t threads) {
+    RngDiceBlocks dice = { .blocks = blocks, .sides = sides };
+    rng_run_blocks(rng, n, threads, rng_fill_dice_block, &dice);
+}
+
+void rng_fill_dice_parallel(Rng *rng, uint8_t *out, size_t n, uint32_t sides, size_t threads) {
+    size_t block_count = (n + RNG_BLOCK - 1) / RNG_BLOCK;
+    uint8_t **blocks = malloc((block_count + 1) * sizeof(uint8_t*));
+
+    for(size_t b = 0; b < block_count; b++) blocks[b] = out + b * RNG_BLOCK;
+
+    rng_fill_dice_blocks(rng, blocks, n, sides, threads);
+
+    free(blocks);
+}
+
+#endif // RNG_IMPLEMENTATION